@@ -3,19 +3,35 @@
 #include <algorithm> // For transform
 #include <cctype>    // For tolower
 #include <limits>    // For numeric_limits
+#include <cstdlib>   // For atoi
 #include "ImportedData.h"
 #include "DataImputer.h"
+#include "EncodedDataset.h"
 #include "RegressionTests.h"
 #include "SuggestionMaker.h"
+#include "AudienceOptimizer.h"
+#include "CrossValidator.h"
+#include "ScoringServer.h"
+#include "StreamingTrainer.h"
 
 using namespace std;
 
+// Seed of the forest the regression test cases are checked against
+const uint32_t REGRESSION_SEED = 42;
+
 // Function Declarations
-void testEfficiency(vector<DataPoint>& dataPoints, vector<string>& attributes, int numTrees);
-void testScalability(vector<DataPoint>& dataPoints, vector<string>& attributes, int numTrees);
-void testAccuracy(vector<DataPoint>& dataPoints, vector<string>& attributes, int numTrees);
+RandomForest testEfficiency(const EncodedDataset& data, vector<string>& attributes, int numTrees);
+void testScalability(const EncodedDataset& data, vector<string>& attributes, int numTrees);
+void testAccuracy(const RandomForest& rf);
 bool isValidBrowsingHistory(const string& browsingHistory);
-void userAdInteraction(vector<DataPoint>& dataPoints, vector<string>& attributes, int numTrees);
+void userAdInteraction(const EncodedDataset& data, vector<string>& attributes, int numTrees, const string& modelPath);
+bool loadTrainingData(const string& filePath, EncodedDataset& data);
+int optimizeAudience(const string& filePath, const string& audiencePath, const string& outputPath, int numTrees, const string& modelPath);
+int tuneHyperparameters(const string& filePath, int numFolds);
+int serveModel(const string& modelPath, const string& endpoint);
+int trainStreaming(const string& filePath, const string& modelPath, int numTrees);
+bool saveModel(const RandomForest& rf, const EncodedDataset& data, const string& modelPath);
+bool saveModel(const RandomForest& rf, const ImputationStats& stats, const string& modelPath);
 
 // Helper function to convert a string to lowercase
 string toLowerCase(const string& str) {
@@ -31,14 +47,33 @@ bool isValidBrowsingHistory(const string& browsingHistory) {
     return find(validOptions.begin(), validOptions.end(), lowerInput) != validOptions.end();
 }
 
-// Function to test system efficiency
-void testEfficiency(vector<DataPoint>& dataPoints, vector<string>& attributes, int numTrees) {
+// Saves a model together with the imputation statistics of its training data (in
+// <modelPath>.stats), so that serving can fill missing request values the same way
+bool saveModel(const RandomForest& rf, const EncodedDataset& data, const string& modelPath) {
+    ImputationStats stats;
+    stats.update(data);
+    return saveModel(rf, stats, modelPath);
+}
+
+bool saveModel(const RandomForest& rf, const ImputationStats& stats, const string& modelPath) {
+    if (!rf.save(modelPath) || !stats.save(modelPath + ".stats")) {
+        cerr << "Warning: could not save model to " << modelPath << endl;
+        return false;
+    }
+    return true;
+}
+
+// Function to test system efficiency; returns the trained forest so later tests can reuse it
+RandomForest testEfficiency(const EncodedDataset& data, vector<string>& attributes, int numTrees) {
     cout << "\n--- Efficiency Testing ---" << endl;
 
     auto start = chrono::high_resolution_clock::now();
 
-    // Train the RandomForest model
-    RandomForest rf = trainRandomForest(dataPoints, attributes, numTrees);
+    // Train the RandomForest model. testCases checks and saves this forest; a fixed seed makes
+    // it, and so the results checked there, the same on every run.
+    RandomForest rf(numTrees);
+    rf.setSeed(REGRESSION_SEED);
+    rf.train(data, attributes);
 
     auto end = chrono::high_resolution_clock::now();
     cout << "Training time: "
@@ -47,23 +82,23 @@ void testEfficiency(vector<DataPoint>& dataPoints, vector<string>& attributes, i
 
     // Measure prediction time for the entire dataset
     start = chrono::high_resolution_clock::now();
-    for (const auto& dp : dataPoints) {
-        rf.predict(dp);
-    }
+    vector<int> predictions(data.size());
+    rf.predictBatch(data.batch(), predictions.data());
     end = chrono::high_resolution_clock::now();
-    cout << "Prediction time for " << dataPoints.size() << " impressions: "
+    cout << "Prediction time for " << data.size() << " impressions: "
         << chrono::duration_cast<chrono::milliseconds>(end - start).count()
         << " ms" << endl;
+    return rf;
 }
 
 // Function to test system scalability
-void testScalability(vector<DataPoint>& dataPoints, vector<string>& attributes, int numTrees) {
+void testScalability(const EncodedDataset& data, vector<string>& attributes, int numTrees) {
     cout << "\n--- Scalability Testing ---" << endl;
 
-    vector<size_t> datasetSizes = { dataPoints.size() / 4, dataPoints.size() / 2, (3 * dataPoints.size()) / 4, dataPoints.size() };
+    vector<size_t> datasetSizes = { data.size() / 4, data.size() / 2, (3 * data.size()) / 4, data.size() };
 
     for (size_t datasetSize : datasetSizes) {
-        vector<DataPoint> subset(dataPoints.begin(), dataPoints.begin() + datasetSize);
+        EncodedDataset subset = data.head(datasetSize);
 
         auto start = chrono::high_resolution_clock::now();
         RandomForest rf = trainRandomForest(subset, attributes, numTrees);
@@ -74,9 +109,8 @@ void testScalability(vector<DataPoint>& dataPoints, vector<string>& attributes,
             << " ms" << endl;
 
         start = chrono::high_resolution_clock::now();
-        for (const auto& dp : subset) {
-            rf.predict(dp);
-        }
+        vector<int> predictions(subset.size());
+        rf.predictBatch(subset.batch(), predictions.data());
         end = chrono::high_resolution_clock::now();
         cout << "Dataset size: " << subset.size()
             << " | Prediction time: "
@@ -85,30 +119,34 @@ void testScalability(vector<DataPoint>& dataPoints, vector<string>& attributes,
     }
 }
 
-// Function to test accuracy
-void testAccuracy(vector<DataPoint>& dataPoints, vector<string>& attributes, int numTrees) {
+// Function to test accuracy, using the out-of-bag estimate recorded while the forest was trained
+// (each row is judged only by trees that did not see it, so no separate forest is needed)
+void testAccuracy(const RandomForest& rf) {
     cout << "\n--- Accuracy Testing ---" << endl;
 
-    RandomForest rf = trainRandomForest(dataPoints, attributes, numTrees);
-
-    int correctPredictions = 0;
-    int totalPredictions = dataPoints.size();
-
-    for (const auto& dp : dataPoints) {
-        int prediction = rf.predict(dp);
-        if (prediction == dp.click) { // Assuming 'click' holds the actual outcome (1 for click, 0 for no click)
-            correctPredictions++;
-        }
+    const OobEstimate& oob = rf.getOobEstimate();
+    if (oob.rows == 0) {
+        cout << "No out-of-bag rows to estimate accuracy from." << endl;
+        return;
     }
 
-    double accuracy = (static_cast<double>(correctPredictions) / totalPredictions) * 100.0;
-    cout << "Accuracy of the Random Forest model: " << accuracy << "%" << endl;
+    cout << "Out-of-bag accuracy of the Random Forest model: " << oob.accuracy * 100.0 << "% over "
+        << oob.rows << " rows (log-loss " << oob.logLoss << ")" << endl;
 }
 
-void testCases(vector<DataPoint>& dataPoints, vector<string>& attributes, int numTrees) {
-    // Train the RandomForest model once and pass it to the test function
+void testCases(RandomForest& rf, const EncodedDataset& data, vector<string>& attributes, const string& modelPath) {
+    // Checks the forest trained by testEfficiency rather than training another one
     cout << "\n--- Test Cases ---" << endl;
-    RandomForest rf = trainRandomForest(dataPoints, attributes, numTrees);
+    testSmallDatasetTraining(data, attributes);
+    testSlidingWindow(data, attributes);
+    testDictionaryLimit();
+    testParallelLoad();
+
+    testKernelAgreement(rf, data);
+    rf.buildLookupTable(); // Suggestions evaluate the forest repeatedly; answer from the table
+
+    // Keep this model so later stages (and other processes) can load it instead of retraining
+    saveModel(rf, data, modelPath);
 
     // Define test cases
     vector<DataPoint> testCases = {
@@ -122,8 +160,10 @@ void testCases(vector<DataPoint>& dataPoints, vector<string>& attributes, int nu
         {21, "Non-Binary", "Mobile", "Top", "Gaming", "Afternoon", -1}    // Test case 8
     };
 
-    vector<int> expectedPredictions = { 0, 1, 1, 0, 1, 1, 1, 1 };
-    vector<string> expectedSuggestions = { "Top", "None", "None", "Side", "None", "Bottom", "Top", "None" };
+    // Results of the seeded forest, which also splits on age. They hold from about 12 trees up;
+    // smaller forests predict no click for some cases.
+    vector<int> expectedPredictions = { 1, 1, 1, 1, 1, 1, 1, 1 };
+    vector<string> expectedSuggestions = { "None", "None", "None", "None", "None", "None", "None", "None" };
 
     // Run the regression tests
     runRegressionTests(rf, testCases, expectedPredictions, expectedSuggestions);
@@ -146,10 +186,15 @@ void testCases(vector<DataPoint>& dataPoints, vector<string>& attributes, int nu
 }
 
 // Function to interact with the user and provide ad suggestions
-void userAdInteraction(vector<DataPoint>& dataPoints, vector<string>& attributes, int numTrees) {
+void userAdInteraction(const EncodedDataset& data, vector<string>& attributes, int numTrees, const string& modelPath) {
     cout << "\n--- User Ad Interaction ---" << endl;
 
-    RandomForest rf = trainRandomForest(dataPoints, attributes, numTrees);
+    // Use the model saved by testCases when there is one
+    RandomForest rf(numTrees);
+    if (!rf.load(modelPath)) {
+        rf = trainRandomForest(data, attributes, numTrees);
+    }
+    rf.buildLookupTable();
 
     char repeat = 'y';
     while (repeat == 'y' || repeat == 'Y') {
@@ -189,8 +234,15 @@ void userAdInteraction(vector<DataPoint>& dataPoints, vector<string>& attributes
         int prediction = rf.predict(userPoint);
         cout << "Prediction: " << (prediction == 1 ? "Click (ad is effective)" : "No Click (ad is not effective)") << endl;
 
+        // Expected click-through rate of every placement, best first
+        vector<string> possiblePlacements = { "Top", "Side", "Bottom" };
+        cout << "Placements by expected click rate:";
+        for (const auto& candidate : rankAdPlacements(userPoint, possiblePlacements, rf)) {
+            cout << " " << candidate.placement << " (" << static_cast<int>(candidate.clickProbability * 100 + 0.5) << "%)";
+        }
+        cout << endl;
+
         if (prediction == 0) {
-            vector<string> possiblePlacements = { "Top", "Side", "Bottom" };
             string suggestion = suggestAdPlacement(userPoint, possiblePlacements, rf);
             cout << "Suggested better ad placement: " << (suggestion != "None" ? suggestion : "No better ad placement found.") << endl;
         }
@@ -200,14 +252,192 @@ void userAdInteraction(vector<DataPoint>& dataPoints, vector<string>& attributes
     }
 }
 
-int main() {
+// Loads the training CSV (from its binary cache when that is current) and imputes it
+bool loadTrainingData(const string& filePath, EncodedDataset& data) {
+    // Reuse the preprocessed binary cache when it matches the CSV; otherwise load straight into
+    // encoded columns. All training and scoring below runs on the integer codes.
+    ImportedData loader(filePath);
+    string cachePath = filePath + ".cache";
+    if (loader.loadCache(cachePath, data)) return true;
+    if (!loader.loadEncoded(data)) {
+        cerr << "Data loading failed! Check the file path and try again." << endl;
+        return false;
+    }
+
+    DataImputer imputer;
+    imputer.impute(data);
+    if (!loader.saveCache(cachePath, data)) {
+        cerr << "Warning: could not write dataset cache " << cachePath << endl;
+    }
+    return true;
+}
+
+// Batch mode: writes the best placement and expected lift for every row of an audience file.
+// With numTrees > 0 a new forest is trained (and saved to modelPath if one is given); otherwise
+// the model at modelPath is used, trained with 100 trees and saved there if it does not exist.
+int optimizeAudience(const string& filePath, const string& audiencePath, const string& outputPath, int numTrees, const string& modelPath) {
+    EncodedDataset data;
+    if (!loadTrainingData(filePath, data)) return 1;
+
+    vector<string> attributes = { "age", "gender", "deviceType", "adPosition", "browsingHistory", "timeOfDay" };
+    RandomForest rf(numTrees > 0 ? numTrees : 100);
+    if (numTrees > 0 || modelPath.empty() || !rf.load(modelPath)) {
+        rf.train(data, attributes);
+        if (!modelPath.empty()) saveModel(rf, data, modelPath);
+    }
+    else {
+        cout << "Using the " << rf.getNumTrees() << "-tree model in " << modelPath << endl;
+    }
+
+    // Audience rows with missing values are filled in from the training data
+    ImputationStats stats;
+    stats.update(data);
+
+    auto start = chrono::high_resolution_clock::now();
+    AudienceOptimizer optimizer(audiencePath);
+    optimizer.setImputationStats(stats);
+    if (!optimizer.optimize(rf, { "Top", "Side", "Bottom" }, outputPath)) {
+        cerr << "Audience optimization failed." << endl;
+        return 1;
+    }
+    auto end = chrono::high_resolution_clock::now();
+
+    cout << "Optimized " << optimizer.getRowsWritten() << " rows in "
+        << chrono::duration_cast<chrono::milliseconds>(end - start).count() << " ms, average expected lift "
+        << optimizer.getAverageLift() << endl;
+    return 0;
+}
+
+// Batch mode: cross-validates a grid of tree counts and growth limits and prints the results
+int tuneHyperparameters(const string& filePath, int numFolds) {
+    EncodedDataset data;
+    if (!loadTrainingData(filePath, data)) return 1;
+
+    vector<string> attributes = { "age", "gender", "deviceType", "adPosition", "browsingHistory", "timeOfDay" };
+    vector<int> treeCounts = { 10, 25, 50, 100 };
+    vector<TreeLimits> limitsGrid(4);
+    limitsGrid[1].maxDepth = 6;
+    limitsGrid[2].maxDepth = 10;
+    limitsGrid[3].minSamplesLeaf = 10;
+
+    auto start = chrono::high_resolution_clock::now();
+    CrossValidator validator(data, attributes);
+    validator.setNumFolds(numFolds);
+    vector<TuningResult> results = validator.run(treeCounts, limitsGrid);
+    auto end = chrono::high_resolution_clock::now();
+    if (results.empty()) {
+        cerr << "Not enough rows for " << numFolds << "-fold cross-validation." << endl;
+        return 1;
+    }
+
+    cout << numFolds << "-fold cross-validation of " << results.size() << " configurations in "
+        << chrono::duration_cast<chrono::milliseconds>(end - start).count() << " ms" << endl;
+    CrossValidator::printTable(results, cout);
+
+    auto best = min_element(results.begin(), results.end(),
+        [](const TuningResult& a, const TuningResult& b) { return a.logLoss < b.logLoss; });
+    cout << "Lowest log-loss: " << best->numTrees << " trees, accuracy " << best->accuracy * 100.0 << "%" << endl;
+    return 0;
+}
+
+// Server mode: answers predict/suggest requests for a saved model until the process is stopped.
+// endpoint is a TCP port on localhost, or otherwise the path of a Unix domain socket.
+int serveModel(const string& modelPath, const string& endpoint) {
+    RandomForest rf(0);
+    if (!rf.load(modelPath)) {
+        cerr << "Failed to load model: " << modelPath << endl;
+        return 1;
+    }
+    rf.buildLookupTable();  // Falls back to tree evaluation if the table would be too large
+
+    ScoringServer server(rf, { "Top", "Side", "Bottom" });
+    ImputationStats stats;
+    if (stats.load(modelPath + ".stats")) {
+        server.setImputationStats(stats);
+    }
+    else {
+        cout << "No imputation statistics in " << modelPath << ".stats; requests with empty fields are rejected" << endl;
+    }
+    bool isPort = !endpoint.empty() && all_of(endpoint.begin(), endpoint.end(), ::isdigit);
+    if (isPort ? !server.listenTcp(atoi(endpoint.c_str())) : !server.listenUnix(endpoint)) return 1;
+
+    cout << "Serving " << rf.getNumTrees() << " trees on " << (isPort ? "127.0.0.1:" : "") << endpoint
+        << (rf.hasLookupTable() ? " (lookup table)" : "") << endl;
+    server.run();
+    return 0;
+}
+
+// Batch mode: trains a forest from a CSV file read in chunks, so files larger than memory can be
+// used, and saves it (with its imputation statistics) for --serve or --optimize --model
+int trainStreaming(const string& filePath, const string& modelPath, int numTrees) {
+    vector<string> attributes = { "age", "gender", "deviceType", "adPosition", "browsingHistory", "timeOfDay" };
+    RandomForest rf(0);
+    StreamingTrainer trainer(filePath);
+
+    auto start = chrono::high_resolution_clock::now();
+    if (!trainer.train(rf, numTrees, attributes)) {
+        cerr << "Data loading failed! Check the file path and try again." << endl;
+        return 1;
+    }
+    auto end = chrono::high_resolution_clock::now();
+    cout << "Trained " << rf.getNumTrees() << " trees in "
+        << chrono::duration_cast<chrono::milliseconds>(end - start).count() << " ms" << endl;
+
+    if (!saveModel(rf, trainer.getImputationStats(), modelPath)) return 1;
+    cout << "Saved model to " << modelPath << endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    // AdStrat --optimize <training.csv> <audience.csv> <output.csv> [numTrees] [--model <path>]
+    if (argc >= 5 && string(argv[1]) == "--optimize") {
+        int numTrees = 0;  // 0 = not given
+        string modelPath;
+        for (int i = 5; i < argc; ++i) {
+            if (string(argv[i]) == "--model" && i + 1 < argc) {
+                modelPath = argv[++i];
+                continue;
+            }
+            numTrees = atoi(argv[i]);
+            if (numTrees < 1) {
+                cerr << "Invalid number of trees." << endl;
+                return 1;
+            }
+        }
+        return optimizeAudience(argv[2], argv[3], argv[4], numTrees, modelPath);
+    }
+
+    // AdStrat --tune <training.csv> [folds]
+    if (argc >= 3 && string(argv[1]) == "--tune") {
+        int numFolds = argc >= 4 ? atoi(argv[3]) : 5;
+        if (numFolds < 2) {
+            cerr << "Invalid number of folds." << endl;
+            return 1;
+        }
+        return tuneHyperparameters(argv[2], numFolds);
+    }
+
+    // AdStrat --train-stream <training.csv> <model> [numTrees]
+    if (argc >= 4 && string(argv[1]) == "--train-stream") {
+        int numTrees = argc >= 5 ? atoi(argv[4]) : 100;
+        if (numTrees < 1) {
+            cerr << "Invalid number of trees." << endl;
+            return 1;
+        }
+        return trainStreaming(argv[2], argv[3], numTrees);
+    }
+
+    // AdStrat --serve <model> [port | unix-socket-path]
+    if (argc >= 3 && string(argv[1]) == "--serve") {
+        return serveModel(argv[2], argc >= 4 ? argv[3] : "7070");
+    }
+
     string filePath;
     cout << "Enter the path to the dataset file (e.g., ../ad_click_dataset.csv): ";
     cin >> filePath;
 
-    ImportedData loader(filePath);
-    if (!loader.loadData()) {
-        cerr << "Data loading failed! Check the file path and try again." << endl;
+    EncodedDataset data;
+    if (!loadTrainingData(filePath, data)) {
         return 1;
     }
 
@@ -220,18 +450,15 @@ int main() {
         return 1;
     }
 
-    DataImputer imputer;
-    vector<DataPoint>& dataPoints = loader.getDataPoints();
-    imputer.impute(dataPoints);
-
-    vector<string> attributes = { "gender", "deviceType", "adPosition", "browsingHistory", "timeOfDay" };
+    vector<string> attributes = { "age", "gender", "deviceType", "adPosition", "browsingHistory", "timeOfDay" };
 
-    testEfficiency(dataPoints, attributes, numTrees);
-    testScalability(dataPoints, attributes, numTrees);
-    testAccuracy(dataPoints, attributes, numTrees);
-    testCases(dataPoints, attributes, numTrees);
+    RandomForest rf = testEfficiency(data, attributes, numTrees);
+    testScalability(data, attributes, numTrees);
+    testAccuracy(rf);
+    string modelPath = filePath + ".model";
+    testCases(rf, data, attributes, modelPath);
 
-    userAdInteraction(dataPoints, attributes, numTrees);
+    userAdInteraction(data, attributes, numTrees, modelPath);
 
     return 0;
 }
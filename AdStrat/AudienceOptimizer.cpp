@@ -0,0 +1,95 @@
+#include "AudienceOptimizer.h"
+#include "ThreadPool.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+bool AudienceOptimizer::optimize(const RandomForest& rf, const vector<string>& placements, const string& outputPath) {
+    rowsWritten = 0;
+    totalLift = 0;
+
+    // Sweep every position the forest knows, plus MISSING_CODE, so each row's current
+    // position is scored too; only the requested placements are candidates for the best one
+    const CategoryDictionary& positions = rf.getSchema().dictionary(COL_AD_POSITION);
+    vector<CategoryCode> sweep;
+    for (size_t code = 0; code < positions.size(); ++code) {
+        sweep.push_back(static_cast<CategoryCode>(code));
+    }
+    sweep.push_back(MISSING_CODE);
+    size_t width = sweep.size();
+
+    vector<size_t> candidates;  // Indices into sweep
+    for (const auto& placement : placements) {
+        CategoryCode code = positions.lookup(placement);
+        if (code == MISSING_CODE) {
+            cerr << "Warning: placement " << placement << " is not known to the model and is skipped" << endl;
+            continue;
+        }
+        candidates.push_back(code);
+    }
+    if (candidates.empty()) return false;
+
+    ofstream out(outputPath, ios::binary | ios::trunc);
+    if (!out.is_open()) {
+        cerr << "Failed to open output file: " << outputPath << endl;
+        return false;
+    }
+    out << "Row,CurrentPosition,CurrentCTR,BestPosition,BestCTR,Lift\n";
+
+    ImportedData reader(fileName);
+    DatasetSchema audienceSchema;
+    DataImputer imputer;
+    ThreadPool pool(numThreads);
+    vector<double> probabilities;
+
+    bool readOk = reader.streamEncoded(chunkBytes, audienceSchema, [&](const EncodedDataset& chunk) {
+        EncodedDataset imputed;
+        const EncodedDataset* rows = &chunk;
+        if (hasStats) {
+            imputed = chunk;
+            imputer.apply(imputed, stats, numThreads);
+            rows = &imputed;
+        }
+
+        vector<CategoryCode> recoded[NUM_CATEGORICAL];
+        EncodedBatch batch = rows->recodedBatch(rf.getSchema(), recoded);
+        probabilities.resize(batch.size * width);
+        rf.predictSweep(batch, COL_AD_POSITION, sweep, nullptr, probabilities.data());
+
+        // Format blocks of rows in parallel, then write them in order
+        const size_t blockRows = 1 << 14;
+        size_t numBlocks = (batch.size + blockRows - 1) / blockRows;
+        vector<string> text(numBlocks);
+        vector<double> lift(numBlocks, 0.0);
+        pool.parallelFor(numBlocks, [&](size_t b) {
+            size_t first = b * blockRows;
+            size_t last = min(first + blockRows, batch.size);
+            char line[256];
+            for (size_t r = first; r < last; ++r) {
+                const double* scores = &probabilities[r * width];
+                CategoryCode current = batch.columns[COL_AD_POSITION][r];
+                double currentScore = scores[current == MISSING_CODE ? width - 1 : current];
+
+                size_t best = candidates[0];
+                for (size_t c : candidates) {
+                    if (scores[c] > scores[best]) best = c;
+                }
+                double gain = scores[best] - currentScore;
+                lift[b] += gain;
+
+                const string& currentName = rows->getSchema().dictionary(COL_AD_POSITION).decode(rows->column(COL_AD_POSITION)[r]);
+                int length = snprintf(line, sizeof(line), "%zu,%s,%.4f,%s,%.4f,%.4f\n", rowsWritten + r + 1,
+                    currentName.c_str(), currentScore, positions.decode(sweep[best]).c_str(), scores[best], gain);
+                text[b].append(line, min<size_t>(length, sizeof(line) - 1));
+            }
+        });
+
+        for (size_t b = 0; b < numBlocks; ++b) {
+            out.write(text[b].data(), text[b].size());
+            totalLift += lift[b];
+        }
+        rowsWritten += batch.size;
+    });
+
+    return readOk && static_cast<bool>(out);
+}
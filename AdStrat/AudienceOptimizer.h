@@ -0,0 +1,46 @@
+#ifndef AUDIENCE_OPTIMIZER_H
+#define AUDIENCE_OPTIMIZER_H
+
+#include <string>
+#include <vector>
+#include "RandomForest.h"
+#include "DataImputer.h"
+#include "ImportedData.h"
+
+using namespace std;
+
+// Finds the best ad placement for every row of an audience CSV (same layout as the training
+// data; the click column may be empty) and streams one result line per row to an output CSV:
+//   Row,CurrentPosition,CurrentCTR,BestPosition,BestCTR,Lift
+// The file is read in bounded chunks; each chunk is scored with one counterfactual sweep over
+// the ad position column, split across threads.
+class AudienceOptimizer {
+    string fileName;
+    size_t chunkBytes = 64 << 20;  // Bytes of CSV held in memory at a time
+    int numThreads = 0;
+    ImputationStats stats;         // Used to fill missing audience values when hasStats is set
+    bool hasStats = false;
+
+    size_t rowsWritten = 0;
+    double totalLift = 0;
+
+public:
+    explicit AudienceOptimizer(const string& file) : fileName(file) {}
+
+    void setChunkBytes(size_t bytes) { chunkBytes = bytes; }
+    void setNumThreads(int threads) { numThreads = threads; }
+
+    // Impute missing audience values from these statistics (normally the training data's);
+    // otherwise they are scored as missing
+    void setImputationStats(const ImputationStats& trainingStats) { stats = trainingStats; hasStats = true; }
+
+    // Scores every row for each of placements and writes the results to outputPath. Returns
+    // false if a file cannot be opened or no placement is known to the forest.
+    bool optimize(const RandomForest& rf, const vector<string>& placements, const string& outputPath);
+
+    // Summary of the last optimize call
+    size_t getRowsWritten() const { return rowsWritten; }
+    double getAverageLift() const { return rowsWritten > 0 ? totalLift / rowsWritten : 0.0; }
+};
+
+#endif // AUDIENCE_OPTIMIZER_H
@@ -0,0 +1,36 @@
+#include "BinaryIO.h"
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+using namespace std;
+
+bool writeFileAtomically(const string& path, const vector<pair<const char*, size_t>>& sections) {
+    string tempPath = path + ".tmp";
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        if (!out.is_open()) return false;
+        for (const auto& section : sections) {
+            out.write(section.first, section.second);
+        }
+        out.close();
+        if (!out) {
+            remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    // Replace the target in one step, so it is never missing
+#ifdef _WIN32
+    bool replaced = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool replaced = rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!replaced) remove(tempPath.c_str());
+    return replaced;
+}
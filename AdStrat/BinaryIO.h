@@ -0,0 +1,94 @@
+#ifndef BINARYIO_H
+#define BINARYIO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Helpers shared by the binary dataset cache and model files. Both formats are a fixed
+// header followed by a payload of little-endian arrays, each padded to 8 bytes so they
+// can be used in place from a memory mapping.
+
+// 64-bit FNV-1a hash, continuing from hash
+inline uint64_t fnv1a(const char* bytes, size_t length, uint64_t hash = 0xCBF29CE484222325ULL) {
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(bytes[i]);
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// 64-bit checksum of a byte range, continuing from hash. Whole 32-byte blocks are read as four
+// words into independent lanes, so large sections are checked at close to memory speed; the
+// remaining bytes go through fnv1a.
+inline uint64_t checksum64(const char* bytes, size_t length, uint64_t hash = 0xCBF29CE484222325ULL) {
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL, prime2 = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t lanes[4] = { hash, hash + prime1, hash + prime2, hash - prime1 };
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        for (int l = 0; l < 4; ++l) {
+            uint64_t word;
+            memcpy(&word, bytes + i + 8 * l, sizeof(word));
+            uint64_t mixed = lanes[l] + word * prime2;
+            lanes[l] = ((mixed << 31) | (mixed >> 33)) * prime1;
+        }
+    }
+
+    uint64_t result = hash ^ length;
+    for (int l = 0; l < 4; ++l) {
+        result = (result ^ lanes[l]) * prime1;
+    }
+    return fnv1a(bytes + i, length - i, result);
+}
+
+// Bytes needed to pad length up to a multiple of 8
+inline size_t paddingTo8(size_t length) {
+    return (8 - length % 8) % 8;
+}
+
+inline void appendBytes(string& out, const void* bytes, size_t length) {
+    out.append(static_cast<const char*>(bytes), length);
+}
+
+inline void padTo8(string& out) {
+    out.append(paddingTo8(out.size()), '\0');
+}
+
+// Writes the byte ranges in order to path + ".tmp", then renames that over path, so readers see
+// either the old file or the complete new one. The temporary file is removed on failure.
+bool writeFileAtomically(const string& path, const vector<pair<const char*, size_t>>& sections);
+
+// Writes a header struct followed by its payload with writeFileAtomically
+template <typename Header>
+bool writeFileAtomically(const string& path, const Header& header, const string& payload) {
+    return writeFileAtomically(path, { { reinterpret_cast<const char*>(&header), sizeof(header) }, { payload.data(), payload.size() } });
+}
+
+// Bounds-checked reader over a payload
+struct PayloadReader {
+    const char* p;
+    const char* end;
+
+    bool read(void* value, size_t length) {
+        if (static_cast<size_t>(end - p) < length) return false;
+        memcpy(value, p, length);
+        p += length;
+        return true;
+    }
+
+    // Returns a pointer to the next length bytes (plus padding to 8) and skips them, or null
+    const char* take(size_t length) {
+        size_t padded = length + paddingTo8(length);
+        if (static_cast<size_t>(end - p) < padded) return nullptr;
+        const char* section = p;
+        p += padded;
+        return section;
+    }
+};
+
+#endif // BINARYIO_H
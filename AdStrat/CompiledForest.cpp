@@ -0,0 +1,127 @@
+#include "CompiledForest.h"
+#include "RandomForest.h"
+#include "ForestKernels.h"
+#include <queue>
+
+// Flattens the pointer trees breadth-first so that sibling nodes are adjacent
+void CompiledForest::compile(const vector<DecisionTree>& trees) {
+    mapping.reset();
+    nodes.clear();
+    roots.clear();
+
+    for (const auto& tree : trees) {
+        roots.push_back(static_cast<uint32_t>(nodes.size()));
+        nodes.push_back(CompiledNode());
+
+        // Pairs of (source node, slot already reserved for it)
+        queue<pair<TreeNode*, uint32_t>> pending;
+        pending.push({ tree.root, roots.back() });
+
+        while (!pending.empty()) {
+            TreeNode* source = pending.front().first;
+            uint32_t slot = pending.front().second;
+            pending.pop();
+
+            CompiledNode compiled;
+            if (!source->left && !source->right) {
+                compiled.feature = -1;
+                compiled.prediction = static_cast<uint8_t>(source->prediction);
+                compiled.value = MISSING_CODE;
+                compiled.clickRate = source->clickRate;
+            }
+            else {
+                compiled.feature = static_cast<int8_t>(source->splitAttribute);
+                compiled.prediction = 0;
+                compiled.value = source->splitValue;
+                compiled.firstChild = static_cast<uint32_t>(nodes.size());
+
+                nodes.push_back(CompiledNode());
+                nodes.push_back(CompiledNode());
+                pending.push({ source->left, compiled.firstChild });
+                pending.push({ source->right, compiled.firstChild + 1 });
+            }
+            nodes[slot] = compiled;
+        }
+    }
+}
+
+void CompiledForest::mapFrom(shared_ptr<const MappedFile> file, const CompiledNode* nodeArray, size_t nodeCount,
+    const uint32_t* rootArray, size_t treeCount) {
+    nodes.clear();
+    roots.clear();
+    mapping = file;
+    mappedNodes = nodeArray;
+    mappedNodeCount = nodeCount;
+    mappedRoots = rootArray;
+    mappedTreeCount = treeCount;
+}
+
+void CompiledForest::ensureOwned() {
+    if (!mapping) return;
+    nodes.assign(mappedNodes, mappedNodes + mappedNodeCount);
+    roots.assign(mappedRoots, mappedRoots + mappedTreeCount);
+    mapping.reset();
+}
+
+// Builds the TreeNode for compiled node n and its subtree
+static TreeNode* decompileNode(const CompiledNode* base, uint32_t n, TreeArena& arena) {
+    TreeNode* node = arena.allocate();
+    if (base[n].feature < 0) {
+        node->prediction = base[n].prediction;
+        node->clickRate = base[n].clickRate;
+        return node;
+    }
+    node->splitAttribute = base[n].feature;
+    node->splitValue = base[n].value;
+    node->left = decompileNode(base, base[n].firstChild, arena);
+    node->right = decompileNode(base, base[n].firstChild + 1, arena);
+    return node;
+}
+
+vector<DecisionTree> CompiledForest::decompile() const {
+    vector<DecisionTree> trees(numTrees());
+    for (size_t t = 0; t < numTrees(); ++t) {
+        trees[t].root = decompileNode(nodeData(), rootData()[t], trees[t].arena);
+    }
+    return trees;
+}
+
+int CompiledForest::votes(const EncodedRow& row) const {
+    int ones = 0;
+    for (size_t t = 0; t < numTrees(); ++t) {
+        ones += predictTree(t, row);
+    }
+    return ones;
+}
+
+double CompiledForest::clickRate(const EncodedRow& row) const {
+    if (numTrees() == 0) return 0.0;
+    double sum = 0;
+    for (size_t t = 0; t < numTrees(); ++t) {
+        sum += nodeData()[leafIndex(t, row)].clickRate;
+    }
+    return sum / numTrees();
+}
+
+// Tree-major evaluation: each tree's nodes stay in cache while it scores the whole batch.
+// Uses the AVX2 kernel when the CPU supports it.
+void CompiledForest::accumulateVotes(const EncodedBatch& batch, uint32_t* votes, float* rates) const {
+    if (avx2Available()) {
+        accumulateVotesAvx2(*this, batch, votes, rates);
+    }
+    else {
+        accumulateVotesScalar(*this, batch, votes, rates);
+    }
+}
+
+// Each row walks the part of a tree above its first test of column once, then finishes the
+// walk per candidate
+void CompiledForest::accumulateSweep(const EncodedBatch& batch, int column, const CategoryCode* values, size_t count,
+    uint32_t* votes, float* rates) const {
+    if (avx2Available()) {
+        accumulateSweepAvx2(*this, batch, column, values, count, votes, rates);
+    }
+    else {
+        accumulateSweepScalar(*this, batch, column, values, count, votes, rates);
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef COMPILED_FOREST_H
+#define COMPILED_FOREST_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "EncodedDataset.h"
+#include "MappedFile.h"
+#include "DecisionTree.h"
+
+using namespace std;
+
+// Node of a compiled tree. Children are stored next to each other: a row goes to
+// firstChild when its code equals value (numeric features: when it is <= value), and to
+// firstChild + 1 otherwise. Leaves have no children, so they keep their click rate in the
+// same slot.
+struct CompiledNode {
+    int8_t feature;       // Feature tested (see FEATURE_AGE), or -1 for a leaf
+    uint8_t prediction;   // Leaf output (0 or 1)
+    CategoryCode value;   // Code (or numeric threshold) that goes to the first child
+    union {
+        uint32_t firstChild;  // Index of the first child within the forest's node array
+        float clickRate;      // Leaf click probability (TreeNode::clickRate)
+    };
+};
+
+// True when a row whose value of the node's feature is x goes to the first child
+inline bool takesFirstChild(const CompiledNode& node, int x) {
+    return node.feature < NUM_CATEGORICAL ? x == node.value : x <= node.value;
+}
+
+// Contiguous, pointer-free copy of a trained forest used for inference. The arrays are
+// either owned or, after mapFrom, read in place from a mapped model file.
+class CompiledForest {
+    vector<CompiledNode> nodes;  // All trees, each laid out breadth-first
+    vector<uint32_t> roots;      // Index of each tree's root in nodes
+
+    // Set while the arrays live in a mapped model file
+    shared_ptr<const MappedFile> mapping;
+    const CompiledNode* mappedNodes = nullptr;
+    const uint32_t* mappedRoots = nullptr;
+    size_t mappedNodeCount = 0;
+    size_t mappedTreeCount = 0;
+
+    // Copies mapped arrays into the owned vectors so they can be modified
+    void ensureOwned();
+
+public:
+    // Flattens the pointer trees into the node array
+    void compile(const vector<DecisionTree>& trees);
+
+    // Uses node and root arrays that live inside a mapped file, which is kept open
+    void mapFrom(shared_ptr<const MappedFile> file, const CompiledNode* nodeArray, size_t nodeCount,
+        const uint32_t* rootArray, size_t treeCount);
+
+    // Rebuilds pointer trees from the compiled arrays (used to keep training a loaded forest)
+    vector<DecisionTree> decompile() const;
+
+    size_t numTrees() const { return mapping ? mappedTreeCount : roots.size(); }
+    size_t numNodes() const { return mapping ? mappedNodeCount : nodes.size(); }
+    const CompiledNode* nodeData() const { return mapping ? mappedNodes : nodes.data(); }
+    const uint32_t* rootData() const { return mapping ? mappedRoots : roots.data(); }
+
+    // Writable nodes, e.g. to refit leaf predictions without changing the structure
+    CompiledNode* mutableNodeData() { ensureOwned(); return nodes.data(); }
+
+    // Returns the index of the leaf that a row reaches in one tree
+    uint32_t leafIndex(size_t tree, const EncodedRow& row) const {
+        const CompiledNode* base = nodeData();
+        uint32_t n = rootData()[tree];
+        while (base[n].feature >= 0) {
+            n = base[n].firstChild + !takesFirstChild(base[n], row.feature(base[n].feature));
+        }
+        return n;
+    }
+
+    // Evaluates one tree iteratively
+    int predictTree(size_t tree, const EncodedRow& row) const {
+        return nodeData()[leafIndex(tree, row)].prediction;
+    }
+
+    // Returns the index of the leaf that row r of a column batch reaches in one tree
+    uint32_t leafIndex(size_t tree, const EncodedBatch& batch, size_t r) const {
+        const CompiledNode* base = nodeData();
+        uint32_t n = rootData()[tree];
+        while (base[n].feature >= 0) {
+            n = base[n].firstChild + !takesFirstChild(base[n], batch.feature(base[n].feature, r));
+        }
+        return n;
+    }
+
+    // Evaluates one tree for row r of a column batch
+    int predictTree(size_t tree, const EncodedBatch& batch, size_t r) const {
+        return nodeData()[leafIndex(tree, batch, r)].prediction;
+    }
+
+    // Number of trees voting for a click
+    int votes(const EncodedRow& row) const;
+
+    // Click probability of a row: the mean click rate of the leaves it reaches
+    double clickRate(const EncodedRow& row) const;
+
+    // Adds the click votes of every tree to votes[0..batch.size), one tree at a time, and,
+    // when rates is not null, the leaf click rates to rates[0..batch.size)
+    void accumulateVotes(const EncodedBatch& batch, uint32_t* votes, float* rates = nullptr) const;
+
+    // Counterfactual evaluation: scores every row of a batch as if its code in column were each
+    // of values[0..count). With AVX2, candidates share the walk down to a tree's first test of
+    // column; the scalar kernel walks them together and splits them only at nodes testing
+    // column. Adds votes and (if not null) leaf click rates at [candidate * batch.size + row].
+    void accumulateSweep(const EncodedBatch& batch, int column, const CategoryCode* values, size_t count,
+        uint32_t* votes, float* rates = nullptr) const;
+};
+
+#endif // COMPILED_FOREST_H
@@ -0,0 +1,120 @@
+#include "CrossValidator.h"
+#include "ThreadPool.h"
+#include <cmath>
+#include <iomanip>
+#include <random>
+
+CrossValidator::CrossValidator(const EncodedDataset& dataset, const vector<string>& attrs)
+    : data(dataset), attributes(attrs), seed(random_device{}()) {}
+
+vector<TuningResult> CrossValidator::run(const vector<int>& treeCounts, const vector<TreeLimits>& limitsGrid) {
+    vector<int> counts;
+    for (int count : treeCounts) {
+        if (count > 0) counts.push_back(count);
+    }
+    sort(counts.begin(), counts.end());
+    counts.erase(unique(counts.begin(), counts.end()), counts.end());
+    if (counts.empty() || limitsGrid.empty() || numFolds < 2 || data.size() < static_cast<size_t>(numFolds)) return {};
+    int maxTrees = counts.back();
+
+    // Fold f validates on positions [f * n / k, (f + 1) * n / k) of a shuffled row order
+    size_t n = data.size();
+    vector<RowIndex> order(n);
+    for (size_t r = 0; r < n; ++r) {
+        order[r] = static_cast<RowIndex>(r);
+    }
+    mt19937 rng(seed);
+    shuffle(order.begin(), order.end(), rng);
+
+    // Fold metrics of every (limits, fold, count), written by the job that owns them
+    size_t jobs = limitsGrid.size() * numFolds;
+    vector<double> accuracies(jobs * counts.size()), logLosses(jobs * counts.size());
+
+    const int* clicks = data.clickColumn();
+    EncodedBatch batch = data.batch();
+
+    // Each job trains one forest on one thread; there are normally more jobs than cores
+    ThreadPool pool(numThreads);
+    pool.parallelFor(jobs, [&](size_t job) {
+        size_t l = job / numFolds, f = job % numFolds;
+        size_t validFirst = f * n / numFolds, validLast = (f + 1) * n / numFolds;
+        vector<RowIndex> trainRows(order.begin(), order.begin() + validFirst);
+        trainRows.insert(trainRows.end(), order.begin() + validLast, order.end());
+        vector<RowIndex> validRows(order.begin() + validFirst, order.begin() + validLast);
+
+        RandomForest rf(maxTrees);
+        rf.setSeed(seed);
+        rf.setNumThreads(1);
+        rf.setShowProgress(false);
+        rf.setTreeLimits(limitsGrid[l]);
+        rf.train(data, trainRows, attributes);
+
+        // Add one tree at a time to running votes and click rates, recording each prefix size
+        const CompiledForest& forest = rf.getCompiledForest();
+        const CompiledNode* nodes = forest.nodeData();
+        vector<uint32_t> votes(validRows.size(), 0);
+        vector<double> rates(validRows.size(), 0.0);
+        size_t c = 0;
+        for (int t = 0; t < maxTrees; ++t) {
+            for (size_t i = 0; i < validRows.size(); ++i) {
+                const CompiledNode& leaf = nodes[forest.leafIndex(t, batch, validRows[i])];
+                votes[i] += leaf.prediction;
+                rates[i] += leaf.clickRate;
+            }
+            if (t + 1 != counts[c]) continue;
+
+            // Same majority rule as RandomForest::predict
+            size_t correct = 0;
+            double logLoss = 0.0;
+            for (size_t i = 0; i < validRows.size(); ++i) {
+                int click = clicks[validRows[i]];
+                int prediction = (votes[i] > static_cast<uint32_t>(t + 1) / 2) ? 1 : 0;
+                double p = min(max(rates[i] / (t + 1), 1e-15), 1.0 - 1e-15);
+                correct += prediction == click ? 1 : 0;
+                logLoss -= click == 1 ? log(p) : log(1.0 - p);
+            }
+            size_t slot = job * counts.size() + c;
+            accuracies[slot] = static_cast<double>(correct) / validRows.size();
+            logLosses[slot] = logLoss / validRows.size();
+            ++c;
+        }
+    });
+
+    vector<TuningResult> results;
+    for (size_t l = 0; l < limitsGrid.size(); ++l) {
+        for (size_t c = 0; c < counts.size(); ++c) {
+            TuningResult result;
+            result.numTrees = counts[c];
+            result.limits = limitsGrid[l];
+
+            double sumSquares = 0.0;
+            for (int f = 0; f < numFolds; ++f) {
+                size_t slot = (l * numFolds + f) * counts.size() + c;
+                result.accuracy += accuracies[slot];
+                result.logLoss += logLosses[slot];
+                sumSquares += accuracies[slot] * accuracies[slot];
+            }
+            result.accuracy /= numFolds;
+            result.logLoss /= numFolds;
+            result.accuracyStdDev = sqrt(max(sumSquares / numFolds - result.accuracy * result.accuracy, 0.0));
+            results.push_back(result);
+        }
+    }
+    return results;
+}
+
+void CrossValidator::printTable(const vector<TuningResult>& results, ostream& out) {
+    out << left << setw(7) << "Trees" << setw(10) << "MaxDepth" << setw(9) << "MinLeaf" << setw(13) << "MinDecrease"
+        << setw(10) << "MaxNodes" << setw(11) << "Accuracy" << setw(9) << "StdDev" << "LogLoss" << endl;
+
+    // 0 limits are shown as "-" (unlimited)
+    auto limit = [](int value) { return value > 0 ? to_string(value) : string("-"); };
+    for (const auto& result : results) {
+        out << left << setw(7) << result.numTrees << setw(10) << limit(result.limits.maxDepth)
+            << setw(9) << result.limits.minSamplesLeaf << setw(13) << result.limits.minImpurityDecrease
+            << setw(10) << limit(result.limits.maxNodes)
+            << fixed << setprecision(4) << setw(11) << result.accuracy << setw(9) << result.accuracyStdDev
+            << result.logLoss << defaultfloat << endl;
+    }
+    out << right;
+}
@@ -0,0 +1,48 @@
+#ifndef CROSS_VALIDATOR_H
+#define CROSS_VALIDATOR_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "RandomForest.h"
+#include "EncodedDataset.h"
+
+using namespace std;
+
+// Validation metrics of one (numTrees, limits) configuration, averaged over the folds
+struct TuningResult {
+    int numTrees = 0;
+    TreeLimits limits;
+    double accuracy = 0.0;        // Mean validation accuracy
+    double accuracyStdDev = 0.0;  // Standard deviation of the fold accuracies
+    double logLoss = 0.0;         // Mean validation log-loss of the click probabilities
+};
+
+// k-fold cross-validation over a grid of tree counts and growth limits. Every fold trains on
+// row subsets of the same encoded dataset, and the fold x limits forests are trained
+// concurrently. Only the largest tree count is trained: trees are added in order, so the
+// smaller counts are scored as prefixes of the same forest.
+class CrossValidator {
+    const EncodedDataset& data;
+    vector<string> attributes;
+    int numFolds = 5;
+    int numThreads = 0;  // Forests trained at the same time (0 = hardware concurrency)
+    uint32_t seed;
+
+public:
+    CrossValidator(const EncodedDataset& dataset, const vector<string>& attrs);
+
+    void setNumFolds(int folds) { numFolds = folds; }
+    void setNumThreads(int threads) { numThreads = threads; }
+    void setSeed(uint32_t s) { seed = s; }
+
+    // Evaluates every combination of treeCounts and limitsGrid; results are ordered by limits,
+    // then by tree count. Returns no results if there are fewer rows than folds.
+    vector<TuningResult> run(const vector<int>& treeCounts, const vector<TreeLimits>& limitsGrid);
+
+    // Writes results as an aligned text table
+    static void printTable(const vector<TuningResult>& results, ostream& out);
+};
+
+#endif // CROSS_VALIDATOR_H
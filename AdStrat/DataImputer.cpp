@@ -1,77 +1,245 @@
 #include "DataImputer.h"
-#include <unordered_map>
-#include <numeric>
 #include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "BinaryIO.h"
+#include "ThreadPool.h"
 #include "global.h"
 
-void DataImputer::impute(std::vector<DataPoint>& dataset) {
-    // Impute missing values for numerical and categorical attributes
-    imputeNumerical(dataset, "age");
-    imputeCategorical(dataset, "gender");
-    imputeCategorical(dataset, "deviceType");
-    imputeCategorical(dataset, "adPosition");
-    imputeCategorical(dataset, "browsingHistory");
-    imputeCategorical(dataset, "timeOfDay");
-}
+// Rows handled per task by the parallel passes
+static const size_t IMPUTE_BLOCK_ROWS = 1 << 16;
+
+// Binary layout of a statistics file: this header, then the age sum and count, the
+// dictionaries, and one int64 count per dictionary value of each column
+struct StatsHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t payloadBytes;
+    uint64_t checksum;     // FNV-1a of the payload
+    uint32_t numColumns;
+    uint32_t reserved;
+};
+
+static const char STATS_MAGIC[4] = { 'A', 'D', 'S', 'I' };
+static const uint32_t STATS_VERSION = 1;
+
+void ImputationStats::update(const EncodedDataset& dataset, int threads) {
+    // Count each block against the dataset's own codes; the last slot of each column
+    // absorbs MISSING_CODE so the loop has no branch
+    struct BlockCounts {
+        double ageSum = 0;
+        long long ageCount = 0;
+        vector<long long> counts[NUM_CATEGORICAL];
+    };
+    size_t numBlocks = (dataset.size() + IMPUTE_BLOCK_ROWS - 1) / IMPUTE_BLOCK_ROWS;
+    vector<BlockCounts> blocks(numBlocks);
+
+    ThreadPool pool(numBlocks > 1 ? threads : 1);
+    pool.parallelFor(numBlocks, [&](size_t b) {
+        size_t first = b * IMPUTE_BLOCK_ROWS;
+        size_t last = min(first + IMPUTE_BLOCK_ROWS, dataset.size());
+        BlockCounts& block = blocks[b];
 
-void DataImputer::imputeNumerical(std::vector<DataPoint>& dataset, const std::string& attribute) {
-    double sum = 0;
-    int count = 0;
+        const int* ages = dataset.ageColumn();
+        for (size_t r = first; r < last; ++r) {
+            if (ages[r] != MISSING_AGE) {
+                block.ageSum += ages[r];
+                block.ageCount++;
+            }
+        }
+        for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+            const CategoryCode* codes = dataset.column(c);
+            size_t missingSlot = dataset.getSchema().dictionary(c).size();
+            block.counts[c].assign(missingSlot + 1, 0);
+            for (size_t r = first; r < last; ++r) {
+                block.counts[c][min<size_t>(codes[r], missingSlot)]++;
+            }
+        }
+    });
+
+    // Translate the dataset's codes to this schema, in code order so a first update keeps them
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        const CategoryDictionary& source = dataset.getSchema().dictionary(c);
+        for (size_t code = 0; code < source.size(); ++code) {
+            long long count = 0;
+            for (const auto& block : blocks) {
+                count += block.counts[c][code];
+            }
+            CategoryCode target = schema.dictionary(c).encode(source.decode(static_cast<CategoryCode>(code)));
+            frequency[c].resize(schema.dictionary(c).size(), 0);
+            frequency[c][target] += count;
+        }
+    }
+    for (const auto& block : blocks) {
+        ageSum += block.ageSum;
+        ageCount += block.ageCount;
+    }
+}
 
-    // Compute sum and count for non-missing values
+void ImputationStats::update(const vector<DataPoint>& dataset) {
     for (const auto& point : dataset) {
-        if (attribute == "age" && point.age != -1) { // Assuming -1 represents missing data for age
-            sum += point.age;
-            count++;
+        if (point.age != MISSING_AGE) {
+            ageSum += point.age;
+            ageCount++;
+        }
+        for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+            CategoryCode code = schema.dictionary(c).encode(columnValue(point, c));
+            if (code == MISSING_CODE) continue;
+            if (code >= frequency[c].size()) frequency[c].resize(code + 1, 0);
+            frequency[c][code]++;
         }
     }
+}
 
-    // Calculate the mean, or set it to 0 if there are no valid entries
-    double mean = count > 0 ? sum / count : 0;
+void ImputationStats::merge(const ImputationStats& other) {
+    ageSum += other.ageSum;
+    ageCount += other.ageCount;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        const CategoryDictionary& source = other.schema.dictionary(c);
+        for (size_t code = 0; code < source.size(); ++code) {
+            CategoryCode target = schema.dictionary(c).encode(source.decode(static_cast<CategoryCode>(code)));
+            frequency[c].resize(schema.dictionary(c).size(), 0);
+            frequency[c][target] += other.frequency[c][code];
+        }
+    }
+}
 
-    // Impute missing values with the mean
-    for (auto& point : dataset) {
-        if (attribute == "age" && point.age == -1) { // Impute missing age with mean
-            point.age = static_cast<int>(mean);
+const string& ImputationStats::mode(int column) const {
+    CategoryCode mode = MISSING_CODE;
+    long long maxCount = 0;
+    for (size_t code = 0; code < frequency[column].size(); ++code) {
+        if (frequency[column][code] > maxCount) {
+            maxCount = frequency[column][code];
+            mode = static_cast<CategoryCode>(code);
         }
     }
+    return schema.dictionary(column).decode(mode);
 }
 
-void DataImputer::imputeCategorical(std::vector<DataPoint>& dataset, const std::string& attribute) {
-    std::unordered_map<std::string, int> frequency;
+bool ImputationStats::save(const string& path) const {
+    string payload;
+    appendBytes(payload, &ageSum, sizeof(ageSum));
+    int64_t count = ageCount;
+    appendBytes(payload, &count, sizeof(count));
+    schema.serialize(payload);
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        for (size_t code = 0; code < schema.dictionary(c).size(); ++code) {
+            int64_t value = code < frequency[c].size() ? frequency[c][code] : 0;
+            appendBytes(payload, &value, sizeof(value));
+        }
+    }
 
-    // Count frequency of each category for the attribute
-    for (const auto& point : dataset) {
-        std::string value;
+    StatsHeader header = {};
+    memcpy(header.magic, STATS_MAGIC, sizeof(STATS_MAGIC));
+    header.version = STATS_VERSION;
+    header.payloadBytes = payload.size();
+    header.checksum = fnv1a(payload.data(), payload.size());
+    header.numColumns = NUM_CATEGORICAL;
 
-        if (attribute == "gender") value = point.gender;
-        else if (attribute == "deviceType") value = point.deviceType;
-        else if (attribute == "adPosition") value = point.adPosition;
-        else if (attribute == "browsingHistory") value = point.browsingHistory;
-        else if (attribute == "timeOfDay") value = point.timeOfDay;
+    return writeFileAtomically(path, header, payload);
+}
 
-        // If the value is not missing (empty), increment its frequency
-        if (!value.empty()) {
-            frequency[value]++;
-        }
+bool ImputationStats::load(const string& path) {
+    ifstream in(path, ios::binary);
+    if (!in.is_open()) return false;
+
+    StatsHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        memcmp(header.magic, STATS_MAGIC, sizeof(STATS_MAGIC)) != 0 || header.version != STATS_VERSION ||
+        header.numColumns != NUM_CATEGORICAL || header.payloadBytes > (1ULL << 32)) {
+        return false;
+    }
+    string payload(header.payloadBytes, '\0');
+    if (!in.read(&payload[0], payload.size()) || fnv1a(payload.data(), payload.size()) != header.checksum) {
+        return false;
     }
 
-    // Find the most frequent value (mode)
-    std::string mode = "";
-    int maxCount = 0;
-    for (const auto& pair : frequency) {
-        if (pair.second > maxCount) {
-            maxCount = pair.second;
-            mode = pair.first;
+    ImputationStats loaded;
+    PayloadReader reader = { payload.data(), payload.data() + payload.size() };
+    int64_t count;
+    if (!reader.read(&loaded.ageSum, sizeof(loaded.ageSum)) || !reader.read(&count, sizeof(count)) ||
+        !loaded.schema.deserialize(reader)) {
+        return false;
+    }
+    loaded.ageCount = count;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        loaded.frequency[c].resize(loaded.schema.dictionary(c).size());
+        for (auto& value : loaded.frequency[c]) {
+            int64_t stored;
+            if (!reader.read(&stored, sizeof(stored))) return false;
+            value = stored;
         }
     }
+    if (reader.p != reader.end) return false;
+
+    *this = loaded;
+    return true;
+}
+
+void DataImputer::impute(std::vector<DataPoint>& dataset) {
+    // One pass gathers the age mean and the frequencies of every attribute, a second fills them in
+    ImputationStats stats;
+    stats.update(dataset);
+    apply(dataset, stats);
+}
+
+void DataImputer::apply(std::vector<DataPoint>& dataset, const ImputationStats& stats) {
+    int meanAge = static_cast<int>(stats.ageMean());
+    const std::string* modes[NUM_CATEGORICAL];
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        modes[c] = &stats.mode(c);
+    }
 
-    // Impute missing values with the mode (most frequent value)
     for (auto& point : dataset) {
-        if (attribute == "gender" && point.gender.empty()) point.gender = mode;
-        else if (attribute == "deviceType" && point.deviceType.empty()) point.deviceType = mode;
-        else if (attribute == "adPosition" && point.adPosition.empty()) point.adPosition = mode;
-        else if (attribute == "browsingHistory" && point.browsingHistory.empty()) point.browsingHistory = mode;
-        else if (attribute == "timeOfDay" && point.timeOfDay.empty()) point.timeOfDay = mode;
+        if (point.age == MISSING_AGE) point.age = meanAge;
+        for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+            std::string& value = columnValue(point, c);
+            if (value.empty()) value = *modes[c];
+        }
+    }
+}
+
+void DataImputer::apply(EncodedDataset& dataset, const ImputationStats& stats, int threads) {
+    // Modes seen only in earlier batches are added to this dataset's dictionaries
+    int meanAge = static_cast<int>(stats.ageMean());
+    CategoryCode modes[NUM_CATEGORICAL];
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        modes[c] = dataset.mutableSchema().dictionary(c).encode(stats.mode(c));
+    }
+
+    int* ages = dataset.mutableAgeColumn();
+    CategoryCode* columns[NUM_CATEGORICAL];
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        columns[c] = dataset.mutableColumn(c);
     }
+
+    size_t numBlocks = (dataset.size() + IMPUTE_BLOCK_ROWS - 1) / IMPUTE_BLOCK_ROWS;
+    ThreadPool pool(numBlocks > 1 ? threads : 1);
+    pool.parallelFor(numBlocks, [&](size_t b) {
+        size_t first = b * IMPUTE_BLOCK_ROWS;
+        size_t last = std::min(first + IMPUTE_BLOCK_ROWS, dataset.size());
+
+        // Branch-free selects, which the compiler turns into vector blends
+        for (size_t r = first; r < last; ++r) {
+            ages[r] = ages[r] == MISSING_AGE ? meanAge : ages[r];
+        }
+        for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+            CategoryCode* codes = columns[c];
+            CategoryCode mode = modes[c];
+            for (size_t r = first; r < last; ++r) {
+                codes[r] = codes[r] == MISSING_CODE ? mode : codes[r];
+            }
+        }
+    });
+}
+
+void DataImputer::impute(EncodedDataset& dataset, int threads) {
+    ImputationStats stats;
+    stats.update(dataset, threads);
+    apply(dataset, stats, threads);
+}
+
+void DataImputer::impute(EncodedDataset& batch, ImputationStats& stats, int threads) {
+    stats.update(batch, threads);
+    apply(batch, stats, threads);
 }
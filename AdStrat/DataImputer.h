@@ -4,16 +4,60 @@
 #include <vector>
 #include <string>
 #include "global.h"
+#include "EncodedDataset.h"
+
+// Running statistics that determine the imputed values: the age mean and the frequency of
+// every categorical value. They can be updated with new batches, merged across shards and
+// saved, so appended data can be imputed without rescanning what was already seen.
+class ImputationStats {
+private:
+    double ageSum = 0;
+    long long ageCount = 0;
+    DatasetSchema schema;                               // Values seen so far
+    std::vector<long long> frequency[NUM_CATEGORICAL];  // Indexed by the codes of schema
+
+public:
+    // Adds the non-missing values of a dataset, counting blocks of rows on up to threads
+    // threads (0 = hardware concurrency). The dataset may use any dictionaries.
+    void update(const EncodedDataset& dataset, int threads = 0);
+
+    // Adds the non-missing values of data points
+    void update(const std::vector<DataPoint>& dataset);
+
+    // Adds the statistics of another shard
+    void merge(const ImputationStats& other);
+
+    double ageMean() const { return ageCount > 0 ? ageSum / ageCount : 0; }
+
+    // Most frequent value of a column (the first seen on ties), or "" if it has no values
+    const std::string& mode(int column) const;
+
+    // Number of rows with a recorded age
+    long long ageSamples() const { return ageCount; }
+
+    // Writes the statistics to a binary file, or reads a file written by save (returning false
+    // and leaving the statistics unchanged if it is missing or invalid)
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+};
 
 class DataImputer {
 public:
     // Function to impute missing data for all attributes
     void impute(std::vector<DataPoint>& dataset);
 
-private:
-    // Helper functions to impute specific types of attributes
-    void imputeNumerical(std::vector<DataPoint>& dataset, const std::string& attribute);
-    void imputeCategorical(std::vector<DataPoint>& dataset, const std::string& attribute);
+    // Same imputation for a dictionary-encoded dataset (missing categories are MISSING_CODE).
+    // One fused pass computes the statistics of every column, split across threads, and a
+    // second pass fills the missing values.
+    void impute(EncodedDataset& dataset, int threads = 0);
+
+    // Imputes a new batch from running statistics: the batch is first added to stats, then
+    // filled from everything stats has seen
+    void impute(EncodedDataset& batch, ImputationStats& stats, int threads = 0);
+
+    // Replaces missing values using previously computed statistics
+    void apply(std::vector<DataPoint>& dataset, const ImputationStats& stats);
+    void apply(EncodedDataset& dataset, const ImputationStats& stats, int threads = 0);
 };
 
 #endif  // DATAIMPUTER_H
@@ -0,0 +1,45 @@
+#ifndef DECISION_TREE_H
+#define DECISION_TREE_H
+
+#include <memory>
+#include <vector>
+#include "EncodedDataset.h"
+
+using namespace std;
+
+// Define the structure for decision tree nodes
+struct TreeNode {
+    int splitAttribute = -1;                 // Feature tested at this node (see FEATURE_AGE)
+    CategoryCode splitValue = MISSING_CODE;  // Rows with this code (numeric: at most this value) go left
+    TreeNode* left = nullptr;
+    TreeNode* right = nullptr;
+    int prediction = -1; // -1 for non-leaf nodes, 0 or 1 for leaf nodes
+    float clickRate = 0; // Leaves: weighted fraction of the training rows reaching them that clicked
+};
+
+// Hands out the nodes of one tree from contiguous blocks, which are all freed together when
+// the arena is destroyed. Node addresses stay valid while the arena lives. Move-only.
+class TreeArena {
+    vector<unique_ptr<TreeNode[]>> blocks;
+    size_t used = 0;      // Nodes handed out from the last block
+    size_t capacity = 0;  // Size of the last block
+
+public:
+    // Returns a default-initialised node
+    TreeNode* allocate() {
+        if (used == capacity) {
+            capacity = capacity == 0 ? 64 : min<size_t>(capacity * 2, 4096);
+            blocks.emplace_back(new TreeNode[capacity]);
+            used = 0;
+        }
+        return &blocks.back()[used++];
+    }
+};
+
+// A decision tree together with the arena that owns its nodes
+struct DecisionTree {
+    TreeNode* root = nullptr;
+    TreeArena arena;
+};
+
+#endif // DECISION_TREE_H
@@ -0,0 +1,387 @@
+#include "EncodedDataset.h"
+#include "BinaryIO.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+static const string COLUMN_NAMES[NUM_CATEGORICAL] = { "gender", "deviceType", "adPosition", "browsingHistory", "timeOfDay" };
+static const string EMPTY_VALUE = "";
+
+const string& columnName(int column) {
+    return COLUMN_NAMES[column];
+}
+
+int columnIndex(const string& attribute) {
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        if (COLUMN_NAMES[c] == attribute) return c;
+    }
+    return -1;
+}
+
+int featureIndex(const string& attribute) {
+    if (attribute == "age") return FEATURE_AGE;
+    return columnIndex(attribute);
+}
+
+const string& columnValue(const DataPoint& dp, int column) {
+    switch (column) {
+    case COL_GENDER: return dp.gender;
+    case COL_DEVICE_TYPE: return dp.deviceType;
+    case COL_AD_POSITION: return dp.adPosition;
+    case COL_BROWSING_HISTORY: return dp.browsingHistory;
+    default: return dp.timeOfDay;
+    }
+}
+
+string& columnValue(DataPoint& dp, int column) {
+    return const_cast<string&>(columnValue(static_cast<const DataPoint&>(dp), column));
+}
+
+// Returns the code for a value, adding it to the dictionary if needed
+CategoryCode CategoryDictionary::encode(const string& value) {
+    if (value.empty()) return MISSING_CODE;
+
+    auto it = codes.find(value);
+    if (it != codes.end()) return it->second;
+    if (full()) return MISSING_CODE;
+
+    CategoryCode code = static_cast<CategoryCode>(values.size());
+    values.push_back(value);
+    codes.emplace(value, code);
+    return code;
+}
+
+CategoryCode CategoryDictionary::encode(const char* text, size_t length) {
+    if (length == 0) return MISSING_CODE;
+
+    // Columns are low-cardinality, so a short scan beats hashing a freshly built string
+    if (values.size() <= 16) {
+        for (size_t code = 0; code < values.size(); ++code) {
+            if (values[code].size() == length && values[code].compare(0, length, text, length) == 0) {
+                return static_cast<CategoryCode>(code);
+            }
+        }
+    }
+    return encode(string(text, length));
+}
+
+// Returns the code for a value without modifying the dictionary
+CategoryCode CategoryDictionary::lookup(const string& value) const {
+    auto it = codes.find(value);
+    return it != codes.end() ? it->second : MISSING_CODE;
+}
+
+const string& CategoryDictionary::decode(CategoryCode code) const {
+    return code < values.size() ? values[code] : EMPTY_VALUE;
+}
+
+EncodedBatch EncodedBatch::slice(size_t first, size_t count) const {
+    EncodedBatch sub;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        sub.columns[c] = columns[c] + first;
+    }
+    sub.ages = ages + first;
+    sub.size = count;
+    return sub;
+}
+
+// Encodes a row against the dictionaries (unseen values become MISSING_CODE)
+EncodedRow DatasetSchema::encodeRow(const DataPoint& dp) const {
+    EncodedRow row;
+    row.age = dp.age;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        row.codes[c] = dictionaries[c].lookup(columnValue(dp, c));
+    }
+    return row;
+}
+
+DataPoint DatasetSchema::decodeRow(const EncodedRow& row) const {
+    DataPoint dp;
+    dp.age = row.age;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        columnValue(dp, c) = dictionaries[c].decode(row.codes[c]);
+    }
+    dp.click = -1;
+    return dp;
+}
+
+void DatasetSchema::serialize(string& out) const {
+    size_t start = out.size();
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        uint32_t count = static_cast<uint32_t>(dictionaries[c].size());
+        appendBytes(out, &count, sizeof(count));
+        for (uint32_t code = 0; code < count; ++code) {
+            const string& value = dictionaries[c].decode(static_cast<CategoryCode>(code));
+            uint32_t length = static_cast<uint32_t>(value.size());
+            appendBytes(out, &length, sizeof(length));
+            out.append(value);
+        }
+    }
+    out.append(paddingTo8(out.size() - start), '\0');
+}
+
+bool DatasetSchema::deserialize(PayloadReader& reader) {
+    const char* start = reader.p;
+    DatasetSchema loaded;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        uint32_t count;
+        if (!reader.read(&count, sizeof(count))) return false;
+        for (uint32_t code = 0; code < count; ++code) {
+            uint32_t length;
+            if (!reader.read(&length, sizeof(length)) || static_cast<size_t>(reader.end - reader.p) < length) return false;
+            // Every stored value is distinct and non-empty, so each must get a code of its own
+            if (length == 0 || loaded.dictionaries[c].encode(reader.p, length) != code) return false;
+            reader.p += length;
+        }
+    }
+    size_t padding = paddingTo8(reader.p - start);
+    if (static_cast<size_t>(reader.end - reader.p) < padding) return false;
+    reader.p += padding;
+
+    *this = loaded;
+    return true;
+}
+
+// Encodes a (normally already imputed) dataset
+EncodedDataset::EncodedDataset(const vector<DataPoint>& data) {
+    reserve(data.size());
+    for (const auto& dp : data) {
+        addRow(dp);
+    }
+}
+
+void EncodedDataset::ensureOwned() {
+    if (!mapping) return;
+
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        columns[c].assign(mappedColumns[c], mappedColumns[c] + mappedRows);
+    }
+    ages.assign(mappedAges, mappedAges + mappedRows);
+    clicks.assign(mappedClicks, mappedClicks + mappedRows);
+    mapping.reset();
+}
+
+void EncodedDataset::addRow(const DataPoint& dp) {
+    ensureOwned();
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        columns[c].push_back(schema.dictionary(c).encode(columnValue(dp, c)));
+    }
+    ages.push_back(dp.age);
+    clicks.push_back(dp.click);
+}
+
+void EncodedDataset::addEncodedRow(int age, const CategoryCode* codes, int click) {
+    ensureOwned();
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        columns[c].push_back(codes[c]);
+    }
+    ages.push_back(age);
+    clicks.push_back(click);
+}
+
+void EncodedDataset::reserve(size_t count) {
+    ensureOwned();
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        columns[c].reserve(count);
+    }
+    ages.reserve(count);
+    clicks.reserve(count);
+}
+
+void EncodedDataset::resize(size_t count) {
+    ensureOwned();
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        columns[c].resize(count);
+    }
+    ages.resize(count);
+    clicks.resize(count);
+}
+
+EncodedDataset EncodedDataset::head(size_t count) const {
+    count = min(count, size());
+
+    EncodedDataset subset;
+    subset.schema = schema;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        subset.columns[c].assign(column(c), column(c) + count);
+    }
+    subset.ages.assign(ageColumn(), ageColumn() + count);
+    subset.clicks.assign(clickColumn(), clickColumn() + count);
+    return subset;
+}
+
+EncodedRow EncodedDataset::row(size_t r) const {
+    EncodedRow encoded;
+    encoded.age = ageColumn()[r];
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        encoded.codes[c] = column(c)[r];
+    }
+    return encoded;
+}
+
+EncodedBatch EncodedDataset::batch(size_t first, size_t count) const {
+    first = min(first, size());
+    count = min(count, size() - first);
+
+    EncodedBatch block;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        block.columns[c] = column(c) + first;
+    }
+    block.ages = ageColumn() + first;
+    block.size = count;
+    return block;
+}
+
+EncodedBatch EncodedDataset::recodedBatch(const DatasetSchema& target, vector<CategoryCode> storage[NUM_CATEGORICAL]) const {
+    EncodedBatch all = batch();
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        const CategoryDictionary& source = schema.dictionary(c);
+        vector<CategoryCode> codeMap(source.size());
+        bool identity = true;
+        for (size_t code = 0; code < source.size(); ++code) {
+            codeMap[code] = target.dictionary(c).lookup(source.decode(static_cast<CategoryCode>(code)));
+            identity = identity && codeMap[code] == code;
+        }
+        if (identity) continue;
+
+        const CategoryCode* codes = column(c);
+        storage[c].resize(size());
+        for (size_t r = 0; r < size(); ++r) {
+            storage[c][r] = codes[r] == MISSING_CODE ? MISSING_CODE : codeMap[codes[r]];
+        }
+        all.columns[c] = storage[c].data();
+    }
+    return all;
+}
+
+DataPoint EncodedDataset::decodeRow(size_t r) const {
+    DataPoint dp = schema.decodeRow(row(r));
+    dp.click = clickColumn()[r];
+    return dp;
+}
+
+// Binary cache layout: CacheHeader, then the payload it describes. Within the payload the
+// dictionaries come first (per column: value count, then length-prefixed strings), followed
+// by the age, click and code columns, each starting on an 8-byte boundary.
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t rows;
+    uint64_t sourceStamp;
+    uint64_t payloadBytes;
+    uint64_t checksum;     // checksum64 chained over this header (checksum zero), the dictionaries and each column (padding excluded)
+    uint32_t numColumns;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(int) == sizeof(int32_t), "age and click columns are stored as 32-bit integers");
+
+static const char CACHE_MAGIC[4] = { 'A', 'D', 'S', 'D' };
+static const uint32_t CACHE_VERSION = 4;  // 2: missing ages are imputed instead of stored as 0; 3: checksum64; 4: header checksummed
+
+// Checksum of a header with its checksum field zeroed; the payload checksum continues from it
+static uint64_t headerChecksum(CacheHeader header) {
+    header.checksum = 0;
+    return checksum64(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+bool EncodedDataset::saveBinary(const string& path, uint64_t sourceStamp) const {
+    // The dictionaries are small, so build them in memory to checksum them with the columns
+    string dictionaries;
+    schema.serialize(dictionaries);
+
+    // Columns in file order, each followed by padding to the next 8-byte boundary
+    vector<pair<const char*, size_t>> sections;
+    sections.push_back({ reinterpret_cast<const char*>(ageColumn()), size() * sizeof(int32_t) });
+    sections.push_back({ reinterpret_cast<const char*>(clickColumn()), size() * sizeof(int32_t) });
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        sections.push_back({ reinterpret_cast<const char*>(column(c)), size() * sizeof(CategoryCode) });
+    }
+    static const char padding[8] = {};
+
+    CacheHeader header = {};
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.rows = size();
+    header.sourceStamp = sourceStamp;
+    header.numColumns = NUM_CATEGORICAL;
+    header.payloadBytes = dictionaries.size();
+    for (const auto& section : sections) {
+        header.payloadBytes += section.second + paddingTo8(section.second);
+    }
+    header.checksum = checksum64(dictionaries.data(), dictionaries.size(), headerChecksum(header));
+    for (const auto& section : sections) {
+        header.checksum = checksum64(section.first, section.second, header.checksum);
+    }
+
+    // Header, dictionaries, then each column and its padding, written straight from memory
+    vector<pair<const char*, size_t>> parts;
+    parts.push_back({ reinterpret_cast<const char*>(&header), sizeof(header) });
+    parts.push_back({ dictionaries.data(), dictionaries.size() });
+    for (const auto& section : sections) {
+        parts.push_back(section);
+        parts.push_back({ padding, paddingTo8(section.second) });
+    }
+    return writeFileAtomically(path, parts);
+}
+
+bool EncodedDataset::mapBinary(const string& path, uint64_t sourceStamp) {
+    auto file = make_shared<MappedFile>();
+    if (!file->open(path) || file->size() < sizeof(CacheHeader)) return false;
+
+    CacheHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION ||
+        header.numColumns != NUM_CATEGORICAL || header.sourceStamp != sourceStamp ||
+        header.payloadBytes != file->size() - sizeof(CacheHeader)) {
+        return false;
+    }
+
+    const char* payload = file->data() + sizeof(CacheHeader);
+    const char* payloadEnd = payload + header.payloadBytes;
+
+    // Dictionaries, then columns pointing straight into the mapping. Reading is bounds-checked,
+    // so the sections are located first and checksummed in the same order saveBinary used.
+    PayloadReader reader = { payload, payloadEnd };
+    DatasetSchema loadedSchema;
+    if (!loadedSchema.deserialize(reader)) return false;
+    uint64_t checksum = checksum64(payload, reader.p - payload, headerChecksum(header));
+
+    // Bound the row count by the payload before sizing the columns with it
+    if (header.rows > header.payloadBytes / sizeof(int32_t)) return false;
+    size_t rows = static_cast<size_t>(header.rows);
+    const char* agesSection = reader.take(rows * sizeof(int32_t));
+    const char* clicksSection = reader.take(rows * sizeof(int32_t));
+    const char* codeSections[NUM_CATEGORICAL];
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        codeSections[c] = reader.take(rows * sizeof(CategoryCode));
+        if (!codeSections[c]) return false;
+    }
+    if (!agesSection || !clicksSection) return false;
+
+    checksum = checksum64(agesSection, rows * sizeof(int32_t), checksum);
+    checksum = checksum64(clicksSection, rows * sizeof(int32_t), checksum);
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        checksum = checksum64(codeSections[c], rows * sizeof(CategoryCode), checksum);
+    }
+    if (checksum != header.checksum) return false;
+
+    schema = loadedSchema;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        columns[c].clear();
+        columns[c].shrink_to_fit();
+        mappedColumns[c] = reinterpret_cast<const CategoryCode*>(codeSections[c]);
+    }
+    ages.clear();
+    ages.shrink_to_fit();
+    clicks.clear();
+    clicks.shrink_to_fit();
+    mappedAges = reinterpret_cast<const int*>(agesSection);
+    mappedClicks = reinterpret_cast<const int*>(clicksSection);
+    mappedRows = rows;
+    mapping = file;
+    return true;
+}
@@ -0,0 +1,205 @@
+#ifndef ENCODEDDATASET_H
+#define ENCODEDDATASET_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "global.h"
+#include "MappedFile.h"
+
+using namespace std;
+
+// Integer code stored in place of a categorical string value
+typedef uint16_t CategoryCode;
+
+// Index of a row in an EncodedDataset
+typedef uint32_t RowIndex;
+
+// Code used for empty (missing) values and for values not present in a dictionary
+const CategoryCode MISSING_CODE = 0xFFFF;
+
+// Most distinct values a column can hold: every code below MISSING_CODE
+const size_t MAX_CATEGORY_VALUES = MISSING_CODE;
+
+// Categorical columns of a DataPoint, in a fixed order
+enum CategoricalColumn {
+    COL_GENDER = 0,
+    COL_DEVICE_TYPE,
+    COL_AD_POSITION,
+    COL_BROWSING_HISTORY,
+    COL_TIME_OF_DAY,
+    NUM_CATEGORICAL
+};
+
+// Features a tree can test: the categorical columns, then the numeric ones. Categorical
+// features are tested for equality with a code, numeric ones against a threshold.
+const int FEATURE_AGE = NUM_CATEGORICAL;
+const int NUM_FEATURES = NUM_CATEGORICAL + 1;
+
+// Returns the attribute name used for a column (e.g. "gender")
+const string& columnName(int column);
+
+// Returns the column for an attribute name, or -1 if it is not categorical
+int columnIndex(const string& attribute);
+
+// Returns the feature for an attribute name (categorical columns and "age"), or -1 if unknown
+int featureIndex(const string& attribute);
+
+// Returns the string field of a DataPoint for a categorical column
+const string& columnValue(const DataPoint& dp, int column);
+string& columnValue(DataPoint& dp, int column);
+
+// Maps the distinct values of one categorical column to dense codes
+class CategoryDictionary {
+private:
+    vector<string> values;
+    unordered_map<string, CategoryCode> codes;
+
+public:
+    // Returns the code for a value, adding it to the dictionary if needed (empty -> MISSING_CODE).
+    // A new value that does not fit in a full dictionary is not added and gets MISSING_CODE too.
+    CategoryCode encode(const string& value);
+
+    // Same as encode(string) for raw text; avoids building a string for already known values
+    CategoryCode encode(const char* text, size_t length);
+
+    // Returns the code for a value without modifying the dictionary (unknown -> MISSING_CODE)
+    CategoryCode lookup(const string& value) const;
+
+    // Returns the string for a code (MISSING_CODE -> "")
+    const string& decode(CategoryCode code) const;
+
+    // Number of distinct (non-missing) values
+    size_t size() const { return values.size(); }
+
+    // True once every code is in use, so new values can no longer be added
+    bool full() const { return values.size() >= MAX_CATEGORY_VALUES; }
+};
+
+// A single row with its categorical values replaced by dictionary codes
+struct EncodedRow {
+    int age;
+    CategoryCode codes[NUM_CATEGORICAL];
+
+    // Value of a feature: a code for categorical features, the number for numeric ones
+    int feature(int f) const { return f < NUM_CATEGORICAL ? codes[f] : age; }
+};
+
+// Column pointers for a contiguous block of encoded rows
+struct EncodedBatch {
+    const CategoryCode* columns[NUM_CATEGORICAL];
+    const int* ages;
+    size_t size;
+
+    // Value of feature f for row r (see EncodedRow::feature)
+    int feature(int f, size_t r) const { return f < NUM_CATEGORICAL ? columns[f][r] : ages[r]; }
+
+    // Returns the sub-block [first, first + count)
+    EncodedBatch slice(size_t first, size_t count) const;
+};
+
+struct PayloadReader;
+
+// The dictionaries of every categorical column
+class DatasetSchema {
+private:
+    CategoryDictionary dictionaries[NUM_CATEGORICAL];
+
+public:
+    CategoryDictionary& dictionary(int c) { return dictionaries[c]; }
+    const CategoryDictionary& dictionary(int c) const { return dictionaries[c]; }
+
+    // Encodes a row against the dictionaries (unseen values become MISSING_CODE)
+    EncodedRow encodeRow(const DataPoint& dp) const;
+
+    // Rebuilds a DataPoint from an encoded row (click is set to -1)
+    DataPoint decodeRow(const EncodedRow& row) const;
+
+    // Appends the dictionaries in the binary file layout (per column: value count, then
+    // length-prefixed strings), padded to 8 bytes
+    void serialize(string& out) const;
+
+    // Reads dictionaries written by serialize, advancing reader past them
+    bool deserialize(PayloadReader& reader);
+};
+
+// Column-oriented copy of a dataset with every categorical column dictionary-encoded.
+// The columns are either owned vectors or, after mapBinary, read straight out of a mapped
+// cache file; any mutation first copies mapped columns into owned storage.
+class EncodedDataset {
+private:
+    DatasetSchema schema;
+    vector<CategoryCode> columns[NUM_CATEGORICAL];
+    vector<int> ages;
+    vector<int> clicks;
+
+    // Set while the columns live in a mapped cache file
+    shared_ptr<const MappedFile> mapping;
+    const CategoryCode* mappedColumns[NUM_CATEGORICAL] = {};
+    const int* mappedAges = nullptr;
+    const int* mappedClicks = nullptr;
+    size_t mappedRows = 0;
+
+    // Copies mapped columns into the owned vectors so they can be modified
+    void ensureOwned();
+
+public:
+    EncodedDataset() {}
+
+    // Encodes a (normally already imputed) dataset
+    explicit EncodedDataset(const vector<DataPoint>& data);
+
+    // Appends one row, extending the dictionaries with any new values
+    void addRow(const DataPoint& dp);
+
+    // Appends one row whose categorical values are already encoded with this dataset's schema
+    void addEncodedRow(int age, const CategoryCode* codes, int click);
+
+    // Reserves space for count rows
+    void reserve(size_t count);
+
+    // Grows or shrinks to count rows; new rows are zero-filled and must be written through the mutable columns
+    void resize(size_t count);
+
+    // Returns a dataset holding the first count rows, sharing this dataset's dictionaries
+    EncodedDataset head(size_t count) const;
+
+    // Returns a stored row
+    EncodedRow row(size_t r) const;
+
+    // Returns the rows [first, first + count) as column pointers (count is clamped to the dataset)
+    EncodedBatch batch(size_t first = 0, size_t count = SIZE_MAX) const;
+
+    // Returns every row as a batch encoded with another schema (e.g. a model's). Columns whose
+    // dictionaries differ are translated into storage; values unknown to target become MISSING_CODE.
+    EncodedBatch recodedBatch(const DatasetSchema& target, vector<CategoryCode> storage[NUM_CATEGORICAL]) const;
+
+    // Rebuilds the DataPoint for a stored row
+    DataPoint decodeRow(size_t r) const;
+
+    // Writes the dataset as a binary cache file: a header with the row count, sourceStamp and
+    // a checksum, the dictionaries, then each column as a raw little-endian array
+    bool saveBinary(const string& path, uint64_t sourceStamp) const;
+
+    // Maps a cache file written by saveBinary without parsing the columns. Fails (leaving the
+    // dataset unchanged) if the file is missing, corrupt, or was written for another sourceStamp.
+    bool mapBinary(const string& path, uint64_t sourceStamp);
+
+    size_t size() const { return mapping ? mappedRows : clicks.size(); }
+
+    const CategoryCode* column(int c) const { return mapping ? mappedColumns[c] : columns[c].data(); }
+    const int* ageColumn() const { return mapping ? mappedAges : ages.data(); }
+    const int* clickColumn() const { return mapping ? mappedClicks : clicks.data(); }
+
+    // Writable access for loaders and the imputer
+    CategoryCode* mutableColumn(int c) { ensureOwned(); return columns[c].data(); }
+    int* mutableAgeColumn() { ensureOwned(); return ages.data(); }
+    int* mutableClickColumn() { ensureOwned(); return clicks.data(); }
+    DatasetSchema& mutableSchema() { return schema; }
+
+    const DatasetSchema& getSchema() const { return schema; }
+};
+
+#endif // ENCODEDDATASET_H
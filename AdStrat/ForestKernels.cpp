@@ -0,0 +1,323 @@
+#include "ForestKernels.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ADSTRAT_X86 1
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// GCC and Clang only emit AVX2 instructions inside functions marked for that target;
+// MSVC allows the intrinsics anywhere.
+#if defined(ADSTRAT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define ADSTRAT_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define ADSTRAT_TARGET_AVX2
+#endif
+
+static_assert(sizeof(CompiledNode) == 8, "AVX2 kernel reads CompiledNode as two 32-bit words");
+
+// One tree at a time over the whole batch, one row at a time within the tree
+void accumulateVotesScalar(const CompiledForest& forest, const EncodedBatch& batch, uint32_t* votes, float* rates) {
+    const CompiledNode* nodes = forest.nodeData();
+    for (size_t t = 0; t < forest.numTrees(); ++t) {
+        for (size_t r = 0; r < batch.size; ++r) {
+            const CompiledNode& leaf = nodes[forest.leafIndex(t, batch, r)];
+            votes[r] += leaf.prediction;
+            if (rates) rates[r] += leaf.clickRate;
+        }
+    }
+}
+
+// Walks row r of a batch from node n until a leaf or a node testing column
+static uint32_t walkToColumn(const CompiledNode* nodes, const EncodedBatch& batch, size_t r, uint32_t n, int column) {
+    while (nodes[n].feature >= 0 && nodes[n].feature != column) {
+        n = nodes[n].firstChild + !takesFirstChild(nodes[n], batch.feature(nodes[n].feature, r));
+    }
+    return n;
+}
+
+// Walks row r from node n to a leaf with its code in column replaced by value
+static uint32_t walkWithValue(const CompiledNode* nodes, const EncodedBatch& batch, size_t r, uint32_t n, int column, CategoryCode value) {
+    while (nodes[n].feature >= 0) {
+        int x = nodes[n].feature == column ? value : batch.feature(nodes[n].feature, r);
+        n = nodes[n].firstChild + !takesFirstChild(nodes[n], x);
+    }
+    return n;
+}
+
+// Index of the lowest set bit of a non-zero mask
+static inline unsigned lowestBit(uint64_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<unsigned long>(mask))) return index;
+    _BitScanForward(&index, static_cast<unsigned long>(mask >> 32));
+    return index + 32;
+#else
+    return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+
+// Adds a leaf's vote and rate for row r to every candidate in mask
+static inline void addLeaf(const CompiledNode& leaf, const EncodedBatch& batch, size_t r, uint64_t mask,
+    uint32_t* votes, float* rates) {
+    for (; mask; mask &= mask - 1) {
+        size_t i = lowestBit(mask);
+        votes[i * batch.size + r] += leaf.prediction;
+        if (rates) rates[i * batch.size + r] += leaf.clickRate;
+    }
+}
+
+// Walks row r from node n once for the candidates in mask (at most 64, indexes into values).
+// The group only splits at nodes testing column: candidates taking the first child go left, the
+// rest go right together. A candidate left on its own finishes with walkWithValue.
+static void walkCandidates(const CompiledNode* nodes, const EncodedBatch& batch, size_t r, uint32_t n, int column,
+    const CategoryCode* values, uint64_t mask, uint32_t* votes, float* rates) {
+    while (true) {
+        if ((mask & (mask - 1)) == 0) {
+            unsigned i = lowestBit(mask);
+            addLeaf(nodes[walkWithValue(nodes, batch, r, n, column, values[i])], batch, r, mask, votes, rates);
+            return;
+        }
+        n = walkToColumn(nodes, batch, r, n, column);
+        const CompiledNode& node = nodes[n];
+        if (node.feature < 0) {
+            addLeaf(node, batch, r, mask, votes, rates);
+            return;
+        }
+        uint64_t left = 0;
+        for (uint64_t m = mask; m; m &= m - 1) {
+            unsigned i = lowestBit(m);
+            if (takesFirstChild(node, values[i])) left |= 1ULL << i;
+        }
+        if (left) walkCandidates(nodes, batch, r, node.firstChild, column, values, left, votes, rates);
+        if (left == mask) return;
+        mask &= ~left;
+        n = node.firstChild + 1;
+    }
+}
+
+// Each row walks every tree once per block of 64 candidates; a block is split only at nodes
+// testing column
+void accumulateSweepScalar(const CompiledForest& forest, const EncodedBatch& batch, int column,
+    const CategoryCode* values, size_t count, uint32_t* votes, float* rates) {
+    const CompiledNode* nodes = forest.nodeData();
+    for (size_t block = 0; block < count; block += 64) {
+        size_t blockCount = min<size_t>(64, count - block);
+        uint64_t all = blockCount == 64 ? ~0ULL : (1ULL << blockCount) - 1;
+        uint32_t* blockVotes = votes + block * batch.size;
+        float* blockRates = rates ? rates + block * batch.size : nullptr;
+        for (size_t t = 0; t < forest.numTrees(); ++t) {
+            for (size_t r = 0; r < batch.size; ++r) {
+                walkCandidates(nodes, batch, r, forest.rootData()[t], column, values + block, all, blockVotes, blockRates);
+            }
+        }
+    }
+}
+
+#if defined(ADSTRAT_X86)
+
+bool avx2Available() {
+    static const bool available = [] {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        // The OS must save the YMM registers on context switches
+        return osxsave && avx && avx2 && (_xgetbv(0) & 6) == 6;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }();
+    return available;
+}
+
+// Moves 8 rows down one tree together from the nodes in idx, one level per iteration, until
+// every lane sits on a leaf or on a node testing stopColumn (-1 = leaves only). rowBase holds
+// each lane's offset into the row-major code block (row * 8). Returns the final node indices
+// and stores their first words in leafWord0.
+ADSTRAT_TARGET_AVX2
+static __m256i traverseEight(const int32_t* nodeWords, const int32_t* rowCodes, __m256i rowBase, __m256i idx,
+    int stopColumn, __m256i& leafWord0) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i stop = _mm256_set1_epi32(stopColumn);
+    const __m256i firstNumeric = _mm256_set1_epi32(NUM_CATEGORICAL - 1);
+
+    while (true) {
+        // Word 0 is feature | prediction << 8 | value << 16, word 1 is firstChild
+        __m256i word0 = _mm256_i32gather_epi32(nodeWords, idx, 8);
+        __m256i feature = _mm256_srai_epi32(_mm256_slli_epi32(word0, 24), 24);
+        __m256i isLeaf = _mm256_or_si256(_mm256_cmpgt_epi32(zero, feature), _mm256_cmpeq_epi32(feature, stop));
+        if (_mm256_movemask_epi8(isLeaf) == -1) {
+            leafWord0 = word0;
+            return idx;
+        }
+
+        __m256i firstChild = _mm256_i32gather_epi32(nodeWords + 1, idx, 8);
+        __m256i value = _mm256_srli_epi32(word0, 16);
+
+        // Leaves read column 0 harmlessly and keep their index below
+        __m256i column = _mm256_max_epi32(feature, zero);
+        __m256i code = _mm256_i32gather_epi32(rowCodes, _mm256_add_epi32(rowBase, column), 4);
+
+        // Go to firstChild when the code matches (numeric features: is <= value), firstChild + 1 otherwise
+        __m256i isNumeric = _mm256_cmpgt_epi32(feature, firstNumeric);
+        __m256i notAbove = _mm256_andnot_si256(_mm256_cmpgt_epi32(code, value), _mm256_set1_epi32(-1));
+        __m256i matches = _mm256_blendv_epi8(_mm256_cmpeq_epi32(code, value), notAbove, isNumeric);
+        __m256i next = _mm256_add_epi32(firstChild, _mm256_andnot_si256(matches, one));
+        idx = _mm256_blendv_epi8(next, idx, isLeaf);
+    }
+}
+
+ADSTRAT_TARGET_AVX2
+void accumulateVotesAvx2(const CompiledForest& forest, const EncodedBatch& batch, uint32_t* votes, float* rates) {
+    const size_t chunkSize = 256;  // Rows transposed per pass (8 KB of codes)
+    const size_t stride = 8;       // Values stored per row; NUM_FEATURES padded to a power of two
+    static_assert(NUM_FEATURES <= 8, "row-major code block holds at most 8 features");
+
+    const int32_t* nodeWords = reinterpret_cast<const int32_t*>(forest.nodeData());
+    const uint32_t* roots = forest.rootData();
+    const __m256i laneOffsets = _mm256_setr_epi32(0, 8, 16, 24, 32, 40, 48, 56);
+    const __m256i predictionMask = _mm256_set1_epi32(0xFF);
+
+    alignas(32) int32_t rowCodes[chunkSize * stride];
+
+    for (size_t first = 0; first < batch.size; first += chunkSize) {
+        size_t count = min(chunkSize, batch.size - first);
+        size_t vectorCount = count - count % 8;
+
+        // Transpose the chunk so each lane can gather its own row's code for any column
+        for (size_t r = 0; r < count; ++r) {
+            for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+                rowCodes[r * stride + c] = batch.columns[c][first + r];
+            }
+            rowCodes[r * stride + FEATURE_AGE] = batch.ages[first + r];
+        }
+
+        for (size_t t = 0; t < forest.numTrees(); ++t) {
+            for (size_t r = 0; r < vectorCount; r += 8) {
+                __m256i rowBase = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int32_t>(r * stride)), laneOffsets);
+                __m256i word0;
+                __m256i start = _mm256_set1_epi32(static_cast<int32_t>(roots[t]));
+                __m256i leaf = traverseEight(nodeWords, rowCodes, rowBase, start, -1, word0);
+                __m256i prediction = _mm256_and_si256(_mm256_srli_epi32(word0, 8), predictionMask);
+
+                __m256i* out = reinterpret_cast<__m256i*>(votes + first + r);
+                _mm256_storeu_si256(out, _mm256_add_epi32(_mm256_loadu_si256(out), prediction));
+
+                if (rates) {
+                    // A leaf's second word is its click rate
+                    __m256 rate = _mm256_i32gather_ps(reinterpret_cast<const float*>(nodeWords + 1), leaf, 8);
+                    float* rateOut = rates + first + r;
+                    _mm256_storeu_ps(rateOut, _mm256_add_ps(_mm256_loadu_ps(rateOut), rate));
+                }
+            }
+            for (size_t r = vectorCount; r < count; ++r) {
+                const CompiledNode& node = forest.nodeData()[forest.leafIndex(t, batch, first + r)];
+                votes[first + r] += node.prediction;
+                if (rates) rates[first + r] += node.clickRate;
+            }
+        }
+    }
+}
+
+// Rows share the path down to a tree's first test of column, eight lanes at a time; from there
+// each candidate is walked on its own. Forking candidate groups as the scalar kernel does costs
+// more in lane bookkeeping than it saves here, since candidates part at nearly every test of column.
+ADSTRAT_TARGET_AVX2
+void accumulateSweepAvx2(const CompiledForest& forest, const EncodedBatch& batch, int column,
+    const CategoryCode* values, size_t count, uint32_t* votes, float* rates) {
+    const size_t chunkSize = 256;
+    const size_t stride = 8;
+
+    const CompiledNode* nodes = forest.nodeData();
+    const int32_t* nodeWords = reinterpret_cast<const int32_t*>(nodes);
+    const uint32_t* roots = forest.rootData();
+    const __m256i laneOffsets = _mm256_setr_epi32(0, 8, 16, 24, 32, 40, 48, 56);
+    const __m256i predictionMask = _mm256_set1_epi32(0xFF);
+
+    alignas(32) int32_t rowCodes[chunkSize * stride];
+    alignas(32) uint32_t forks[chunkSize];
+
+    for (size_t first = 0; first < batch.size; first += chunkSize) {
+        size_t chunkCount = min(chunkSize, batch.size - first);
+        size_t vectorCount = chunkCount - chunkCount % 8;
+
+        // The swept column is never read from the batch: the prefix stops before testing it
+        for (size_t r = 0; r < chunkCount; ++r) {
+            for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+                rowCodes[r * stride + c] = batch.columns[c][first + r];
+            }
+            rowCodes[r * stride + FEATURE_AGE] = batch.ages[first + r];
+        }
+
+        for (size_t t = 0; t < forest.numTrees(); ++t) {
+            // Shared prefix: each row stops at a leaf or at the first node testing column
+            for (size_t r = 0; r < vectorCount; r += 8) {
+                __m256i rowBase = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int32_t>(r * stride)), laneOffsets);
+                __m256i word0;
+                __m256i start = _mm256_set1_epi32(static_cast<int32_t>(roots[t]));
+                __m256i fork = traverseEight(nodeWords, rowCodes, rowBase, start, column, word0);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(forks + r), fork);
+            }
+            for (size_t r = vectorCount; r < chunkCount; ++r) {
+                forks[r] = walkToColumn(nodes, batch, first + r, roots[t], column);
+            }
+
+            // Finish the walk once per candidate value
+            for (size_t i = 0; i < count; ++i) {
+                for (size_t r = 0; r < chunkCount; ++r) {
+                    rowCodes[r * stride + column] = values[i];
+                }
+                uint32_t* candidateVotes = votes + i * batch.size + first;
+                float* candidateRates = rates ? rates + i * batch.size + first : nullptr;
+
+                for (size_t r = 0; r < vectorCount; r += 8) {
+                    __m256i rowBase = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int32_t>(r * stride)), laneOffsets);
+                    __m256i word0;
+                    __m256i start = _mm256_load_si256(reinterpret_cast<const __m256i*>(forks + r));
+                    __m256i leaf = traverseEight(nodeWords, rowCodes, rowBase, start, -1, word0);
+                    __m256i prediction = _mm256_and_si256(_mm256_srli_epi32(word0, 8), predictionMask);
+
+                    __m256i* out = reinterpret_cast<__m256i*>(candidateVotes + r);
+                    _mm256_storeu_si256(out, _mm256_add_epi32(_mm256_loadu_si256(out), prediction));
+                    if (candidateRates) {
+                        __m256 rate = _mm256_i32gather_ps(reinterpret_cast<const float*>(nodeWords + 1), leaf, 8);
+                        _mm256_storeu_ps(candidateRates + r, _mm256_add_ps(_mm256_loadu_ps(candidateRates + r), rate));
+                    }
+                }
+                for (size_t r = vectorCount; r < chunkCount; ++r) {
+                    const CompiledNode& leaf = nodes[walkWithValue(nodes, batch, first + r, forks[r], column, values[i])];
+                    candidateVotes[r] += leaf.prediction;
+                    if (candidateRates) candidateRates[r] += leaf.clickRate;
+                }
+            }
+        }
+    }
+}
+
+#else
+
+bool avx2Available() {
+    return false;
+}
+
+void accumulateVotesAvx2(const CompiledForest& forest, const EncodedBatch& batch, uint32_t* votes, float* rates) {
+    accumulateVotesScalar(forest, batch, votes, rates);
+}
+
+void accumulateSweepAvx2(const CompiledForest& forest, const EncodedBatch& batch, int column,
+    const CategoryCode* values, size_t count, uint32_t* votes, float* rates) {
+    accumulateSweepScalar(forest, batch, column, values, count, votes, rates);
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef FOREST_KERNELS_H
+#define FOREST_KERNELS_H
+
+#include <cstdint>
+#include "CompiledForest.h"
+
+using namespace std;
+
+// Batch traversal kernels for CompiledForest. Each adds the click votes of every tree
+// to votes[0..batch.size) and, if rates is not null, the leaf click rates to rates.
+void accumulateVotesScalar(const CompiledForest& forest, const EncodedBatch& batch, uint32_t* votes, float* rates);
+void accumulateVotesAvx2(const CompiledForest& forest, const EncodedBatch& batch, uint32_t* votes, float* rates);
+
+// Counterfactual kernels: score every row as if its code in column were each of values[0..count),
+// adding votes and (if not null) leaf click rates at [candidate * batch.size + row]. The scalar
+// kernel walks all candidates together and splits them only at nodes testing column; the AVX2
+// kernel shares the path above a tree's first test of column and walks the rest per candidate.
+void accumulateSweepScalar(const CompiledForest& forest, const EncodedBatch& batch, int column,
+    const CategoryCode* values, size_t count, uint32_t* votes, float* rates);
+void accumulateSweepAvx2(const CompiledForest& forest, const EncodedBatch& batch, int column,
+    const CategoryCode* values, size_t count, uint32_t* votes, float* rates);
+
+// True when the AVX2 kernel was compiled in and the CPU/OS support it (checked once)
+bool avx2Available();
+
+#endif // FOREST_KERNELS_H
@@ -0,0 +1,56 @@
+#include "ForestLookupTable.h"
+
+bool ForestLookupTable::build(const CompiledForest& forest, const DatasetSchema& schema, size_t maxEntries) {
+    clear();
+
+    // Ages in the same interval between consecutive thresholds take the same paths
+    vector<int> thresholds;
+    for (size_t n = 0; n < forest.numNodes(); ++n) {
+        const CompiledNode& node = forest.nodeData()[n];
+        if (node.feature == FEATURE_AGE) thresholds.push_back(node.value);
+    }
+    sort(thresholds.begin(), thresholds.end());
+    thresholds.erase(unique(thresholds.begin(), thresholds.end()), thresholds.end());
+
+    size_t entries = thresholds.size() + 1;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        radix[c] = schema.dictionary(c).size() + 1;  // Last slot holds MISSING_CODE
+        if (entries > maxEntries / radix[c]) return false;
+        entries *= radix[c];
+    }
+    size_t intervals = thresholds.size() + 1;
+
+    EncodedRow row = {};
+    votes.resize(entries);
+    rates.resize(entries);
+    for (size_t i = 0; i < entries; ++i) {
+        size_t rest = i;
+        if (!thresholds.empty()) {
+            // Any age in the interval will do: its upper threshold, or one past the last
+            size_t interval = rest % intervals;
+            rest /= intervals;
+            row.age = interval < thresholds.size() ? thresholds[interval] : thresholds.back() + 1;
+        }
+        for (int c = NUM_CATEGORICAL - 1; c >= 0; --c) {
+            size_t slot = rest % radix[c];
+            rest /= radix[c];
+            row.codes[c] = slot == radix[c] - 1 ? MISSING_CODE : static_cast<CategoryCode>(slot);
+        }
+        votes[i] = static_cast<uint16_t>(forest.votes(row));
+        rates[i] = static_cast<float>(forest.clickRate(row));
+    }
+    ageThresholds = thresholds;
+    return true;
+}
+
+void ForestLookupTable::lookupBatch(const EncodedBatch& batch, uint32_t* out, float* rateOut) const {
+    CategoryCode codes[NUM_CATEGORICAL];
+    for (size_t r = 0; r < batch.size; ++r) {
+        for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+            codes[c] = batch.columns[c][r];
+        }
+        size_t i = index(codes, batch.ages[r]);
+        out[r] = votes[i];
+        if (rateOut) rateOut[r] = rates[i];
+    }
+}
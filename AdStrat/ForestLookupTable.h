@@ -0,0 +1,50 @@
+#ifndef FOREST_LOOKUP_TABLE_H
+#define FOREST_LOOKUP_TABLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "CompiledForest.h"
+#include "EncodedDataset.h"
+
+using namespace std;
+
+// Click votes and probabilities of a forest precomputed for every combination of categorical codes.
+// Each column gets one slot per dictionary code plus one for MISSING_CODE, which is
+// where unseen values land, so every encodable row has an entry. When the trees split on
+// age, the age thresholds they use divide ages into intervals that form one more column.
+class ForestLookupTable {
+    size_t radix[NUM_CATEGORICAL] = {};
+    vector<int> ageThresholds;  // Sorted distinct age thresholds of the forest
+    vector<uint16_t> votes;
+    vector<float> rates;  // CompiledForest::clickRate of each combination
+
+public:
+    // Fills the table by evaluating the forest once per combination. Returns false (and
+    // leaves the table empty) if it would need more than maxEntries entries.
+    bool build(const CompiledForest& forest, const DatasetSchema& schema, size_t maxEntries);
+
+    bool empty() const { return votes.empty(); }
+    size_t size() const { return votes.size(); }
+    void clear() { votes.clear(); rates.clear(); ageThresholds.clear(); }
+
+    // Mixed-radix index of a row's code combination and age interval
+    size_t index(const CategoryCode* codes, int age) const {
+        size_t i = 0;
+        for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+            size_t slot = codes[c] < radix[c] - 1 ? codes[c] : radix[c] - 1;
+            i = i * radix[c] + slot;
+        }
+        if (ageThresholds.empty()) return i;
+        size_t interval = lower_bound(ageThresholds.begin(), ageThresholds.end(), age) - ageThresholds.begin();
+        return i * (ageThresholds.size() + 1) + interval;
+    }
+
+    int lookup(const EncodedRow& row) const { return votes[index(row.codes, row.age)]; }
+    double lookupRate(const EncodedRow& row) const { return rates[index(row.codes, row.age)]; }
+
+    // Writes the vote count of every row of a batch, and its click probability if rateOut is not null
+    void lookupBatch(const EncodedBatch& batch, uint32_t* out, float* rateOut = nullptr) const;
+};
+
+#endif // FOREST_LOOKUP_TABLE_H
@@ -1,5 +1,10 @@
 #include "ImportedData.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
 #include "global.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 
 using namespace std;
 
@@ -32,7 +37,7 @@ bool ImportedData::loadData() {
 
         // Extract relevant fields, checking for empty columns
         getline(ss, token, ',');
-        dp.age = token.empty() ? 0 : stoi(token);  // If empty, set default value
+        dp.age = token.empty() ? MISSING_AGE : stoi(token);  // If empty, mark as missing for the imputer
 
         getline(ss, dp.gender, ',');
         if (dp.gender.empty()) dp.gender = "";  // Leave empty if no data
@@ -69,6 +74,237 @@ bool ImportedData::loadData() {
     return true;
 }
 
+// Returns the end of the field starting at p (the next comma or the end of the line)
+static const char* fieldEnd(const char* p, const char* lineEnd) {
+    while (p != lineEnd && *p != ',') ++p;
+    return p;
+}
+
+// Parses the integer part of a field such as "22" or "22.0"; empty fields give 0
+static int parseIntField(const char* p, const char* end) {
+    bool negative = p != end && *p == '-';
+    if (negative) ++p;
+
+    int value = 0;
+    while (p != end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        ++p;
+    }
+    return negative ? -value : value;
+}
+
+// Reports every column whose dictionary has run out of codes
+static void reportFullDictionaries(const DatasetSchema& schema) {
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        if (schema.dictionary(c).full()) {
+            cerr << "Column " << columnName(c) << " has more than " << MAX_CATEGORY_VALUES << " distinct values" << endl;
+        }
+    }
+}
+
+// Parses the data lines in [p, end) and appends them to out, extending its dictionaries.
+// Returns false, leaving out partly filled, if a value no longer fits in its column's dictionary.
+static bool parseEncodedRows(const char* p, const char* end, EncodedDataset& out) {
+    CategoryCode codes[NUM_CATEGORICAL];
+    while (p < end) {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!lineEnd) lineEnd = end;
+        const char* next = lineEnd == end ? end : lineEnd + 1;
+        if (lineEnd != p && lineEnd[-1] == '\r') --lineEnd;  // Windows line endings
+
+        if (lineEnd == p) {
+            p = next;
+            continue;
+        }
+
+        // Skip irrelevant columns (ID and Full Name)
+        const char* field = fieldEnd(p, lineEnd);
+        field = fieldEnd(field == lineEnd ? field : field + 1, lineEnd);
+        const char* fieldStart = field == lineEnd ? field : field + 1;
+
+        // Age, then the categorical columns in CategoricalColumn order, then click
+        field = fieldEnd(fieldStart, lineEnd);
+        int age = field == fieldStart ? MISSING_AGE : parseIntField(fieldStart, field);
+
+        for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+            fieldStart = field == lineEnd ? field : field + 1;
+            field = fieldEnd(fieldStart, lineEnd);
+            codes[c] = out.mutableSchema().dictionary(c).encode(fieldStart, field - fieldStart);
+            if (codes[c] == MISSING_CODE && field != fieldStart) return false;
+        }
+
+        fieldStart = field == lineEnd ? field : field + 1;
+        field = fieldEnd(fieldStart, lineEnd);
+        int click = parseIntField(fieldStart, field);
+
+        out.addEncodedRow(age, codes, click);
+        p = next;
+    }
+    return true;
+}
+
+// Loads the CSV file straight into dictionary-encoded columns
+bool ImportedData::loadEncoded(EncodedDataset& out, int threads) {
+    MappedFile file;
+    if (!file.open(fileName)) {
+        cerr << "Failed to open file: " << fileName << endl;
+        return false;
+    }
+
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    // Skip the header line
+    const char* headerEnd = begin ? static_cast<const char*>(memchr(begin, '\n', end - begin)) : nullptr;
+    begin = headerEnd ? headerEnd + 1 : end;
+
+    // Small files are not worth the thread start-up and merge
+    const size_t minChunkBytes = 4 << 20;
+    size_t numChunks = min<size_t>(ThreadPool::resolveThreadCount(threads), (end - begin) / minChunkBytes);
+    if (numChunks <= 1) {
+        out.reserve((end - begin) / 48);  // Rough row count so the columns grow at most a few times
+        if (!parseEncodedRows(begin, end, out)) {
+            reportFullDictionaries(out.getSchema());
+            return false;
+        }
+        return true;
+    }
+
+    // Cut the data into chunks that start right after a newline
+    vector<const char*> bounds = { begin };
+    for (size_t i = 1; i < numChunks; ++i) {
+        const char* cut = max(bounds.back(), begin + (end - begin) * i / numChunks);
+        const char* newline = static_cast<const char*>(memchr(cut, '\n', end - cut));
+        bounds.push_back(newline ? newline + 1 : end);
+    }
+    bounds.push_back(end);
+
+    // Each chunk is parsed with its own local dictionaries
+    vector<EncodedDataset> chunks(numChunks);
+    vector<char> parsed(numChunks, 0);
+    ThreadPool pool(static_cast<int>(numChunks));
+    pool.parallelFor(numChunks, [&](size_t i) {
+        chunks[i].reserve((bounds[i + 1] - bounds[i]) / 48);
+        parsed[i] = parseEncodedRows(bounds[i], bounds[i + 1], chunks[i]);
+    });
+    for (size_t i = 0; i < numChunks; ++i) {
+        if (!parsed[i]) {
+            reportFullDictionaries(chunks[i].getSchema());
+            return false;
+        }
+    }
+
+    // Merge dictionaries in chunk order. Each chunk's codes are in first-appearance order, so
+    // the merged codes come out exactly as a serial load would assign them.
+    vector<vector<CategoryCode>> remap(numChunks * NUM_CATEGORICAL);
+    vector<size_t> offsets(numChunks + 1, out.size());
+    for (size_t i = 0; i < numChunks; ++i) {
+        for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+            const CategoryDictionary& local = chunks[i].getSchema().dictionary(c);
+            vector<CategoryCode>& table = remap[i * NUM_CATEGORICAL + c];
+            for (size_t code = 0; code < local.size(); ++code) {
+                table.push_back(out.mutableSchema().dictionary(c).encode(local.decode(static_cast<CategoryCode>(code))));
+                if (table.back() == MISSING_CODE) {
+                    // The chunks fit on their own, but together they overflow the column
+                    reportFullDictionaries(out.getSchema());
+                    return false;
+                }
+            }
+        }
+        offsets[i + 1] = offsets[i] + chunks[i].size();
+    }
+
+    // Copy the rows into place with their codes rewritten, again one chunk per thread
+    out.resize(offsets[numChunks]);
+    pool.parallelFor(numChunks, [&](size_t i) {
+        const EncodedDataset& chunk = chunks[i];
+        size_t offset = offsets[i];
+        for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+            const vector<CategoryCode>& table = remap[i * NUM_CATEGORICAL + c];
+            const CategoryCode* source = chunk.column(c);
+            CategoryCode* target = out.mutableColumn(c) + offset;
+            for (size_t r = 0; r < chunk.size(); ++r) {
+                target[r] = source[r] == MISSING_CODE ? MISSING_CODE : table[source[r]];
+            }
+        }
+        copy(chunk.ageColumn(), chunk.ageColumn() + chunk.size(), out.mutableAgeColumn() + offset);
+        copy(chunk.clickColumn(), chunk.clickColumn() + chunk.size(), out.mutableClickColumn() + offset);
+    });
+    return true;
+}
+
+uint64_t ImportedData::sourceStamp() const {
+    error_code error;
+    uint64_t bytes = filesystem::file_size(fileName, error);
+    if (error) return 0;
+    auto modified = filesystem::last_write_time(fileName, error);
+    if (error) return 0;
+
+    uint64_t ticks = static_cast<uint64_t>(modified.time_since_epoch().count());
+    return (bytes * 0x9E3779B97F4A7C15ULL) ^ ticks;
+}
+
+bool ImportedData::loadCache(const string& cachePath, EncodedDataset& out) const {
+    uint64_t stamp = sourceStamp();
+    return stamp != 0 && out.mapBinary(cachePath, stamp);
+}
+
+bool ImportedData::saveCache(const string& cachePath, const EncodedDataset& data) const {
+    uint64_t stamp = sourceStamp();
+    return stamp != 0 && data.saveBinary(cachePath, stamp);
+}
+
+// Reads the CSV file in bounded blocks, handing each block's rows to onChunk
+bool ImportedData::streamEncoded(size_t chunkBytes, DatasetSchema& schema, const function<void(const EncodedDataset&)>& onChunk) {
+    ifstream inputFile(fileName, ios::binary);
+    if (!inputFile.is_open()) {
+        cerr << "Failed to open file: " << fileName << endl;
+        return false;
+    }
+
+    string header;
+    getline(inputFile, header);  // Skip the header
+
+    vector<char> buffer;
+    size_t carried = 0;  // Bytes of an incomplete last line kept from the previous block
+    while (true) {
+        buffer.resize(carried + chunkBytes);
+        inputFile.read(buffer.data() + carried, chunkBytes);
+        size_t filled = carried + static_cast<size_t>(inputFile.gcount());
+        bool atEnd = filled < buffer.size();
+        if (filled == 0) break;
+
+        // Parse up to the last complete line; the remainder starts the next block
+        const char* begin = buffer.data();
+        const char* parseEnd = begin + filled;
+        if (!atEnd) {
+            const char* lastNewline = begin + filled;
+            while (lastNewline != begin && lastNewline[-1] != '\n') --lastNewline;
+            if (lastNewline == begin) {
+                // A single line longer than the block; grow the block and keep reading
+                carried = filled;
+                chunkBytes *= 2;
+                continue;
+            }
+            parseEnd = lastNewline;
+        }
+
+        EncodedDataset chunk;
+        chunk.mutableSchema() = schema;
+        if (!parseEncodedRows(begin, parseEnd, chunk)) {
+            reportFullDictionaries(chunk.getSchema());
+            return false;
+        }
+        schema = chunk.getSchema();
+        if (chunk.size() > 0) onChunk(chunk);
+
+        carried = (begin + filled) - parseEnd;
+        memmove(buffer.data(), parseEnd, carried);
+        if (atEnd) break;
+    }
+    return true;
+}
+
 void ImportedData::displayData() {
     for (auto& dp : dataPoints) {  // Removed 'const'
         cout << "Age: " << dp.age
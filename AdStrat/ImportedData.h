@@ -6,7 +6,9 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <functional>
 #include "global.h"
+#include "EncodedDataset.h"
 
 using namespace std;
 
@@ -22,6 +24,28 @@ public:
     // Loads data from the CSV file
     bool loadData();
 
+    // Loads the CSV file straight into dictionary-encoded columns by memory-mapping it.
+    // Values are left unimputed: empty categorical fields become MISSING_CODE and an
+    // empty age becomes MISSING_AGE, as in loadData. Large files are parsed in newline-aligned
+    // chunks on up to threads threads (0 = hardware concurrency); row order and codes
+    // are the same as a single-threaded load.
+    bool loadEncoded(EncodedDataset& out, int threads = 0);
+
+    // Identifies the current version of the CSV file (size and modification time), so a binary
+    // cache can tell whether it was built from it. Returns 0 if the file cannot be examined.
+    uint64_t sourceStamp() const;
+
+    // Maps a binary cache written by saveCache for the current version of the CSV file
+    bool loadCache(const string& cachePath, EncodedDataset& out) const;
+
+    // Writes a binary cache of an already loaded (and normally imputed) dataset
+    bool saveCache(const string& cachePath, const EncodedDataset& data) const;
+
+    // Reads the CSV file in blocks of about chunkBytes and calls onChunk with the rows of each
+    // block, so the whole file is never held in memory. Codes come from (and new values are
+    // added to) schema, which is shared across chunks and calls.
+    bool streamEncoded(size_t chunkBytes, DatasetSchema& schema, const function<void(const EncodedDataset&)>& onChunk);
+
     // Displays all loaded data
     void displayData();
 
@@ -1,178 +1,677 @@
 #include "RandomForest.h"
 #include "global.h"
 #include <iostream> // For displaying progress
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include "BinaryIO.h"
+#include "ThreadPool.h"
 
-namespace std {
+// Draw a bootstrap sample of size n with replacement
+BootstrapSample drawBootstrap(size_t n, mt19937& rng) {
+    BootstrapSample sample;
+    sample.weights.assign(n, 0);
+    for (size_t j = 0; j < n; ++j) {
+        sample.weights[rng() % n]++;
+    }
 
-    // Function to calculate Gini Impurity for a split
-    double calculateGini(const vector<DataPoint>& data) {
-        if (data.empty()) return 0.0;
+    for (size_t r = 0; r < n; ++r) {
+        if (sample.weights[r] > 0) sample.rows.push_back(static_cast<RowIndex>(r));
+    }
+    return sample;
+}
 
-        int total = data.size();
-        int countClick = count_if(data.begin(), data.end(), [](const DataPoint& dp) { return dp.click == 1; });
-        double pClick = static_cast<double>(countClick) / total;
-        double pNoClick = 1.0 - pClick;
+// Draw a bootstrap sample from a subset of the rows
+BootstrapSample drawBootstrap(const vector<RowIndex>& rows, size_t datasetSize, mt19937& rng) {
+    BootstrapSample sample;
+    sample.weights.assign(datasetSize, 0);
+    for (size_t j = 0; j < rows.size(); ++j) {
+        sample.weights[rows[rng() % rows.size()]]++;
+    }
 
-        return 1.0 - (pClick * pClick + pNoClick * pNoClick);
+    for (size_t r = 0; r < datasetSize; ++r) {
+        if (sample.weights[r] > 0) sample.rows.push_back(static_cast<RowIndex>(r));
     }
+    return sample;
+}
 
-    // Split data based on an attribute and value
-    pair<vector<DataPoint>, vector<DataPoint>> splitData(
-        const vector<DataPoint>& data,
-        const string& attribute,
-        const string& value) {
+// Gini Impurity of a group from its click counts
+double giniFromCounts(int64_t total, int64_t clicks) {
+    if (total == 0) return 0.0;
 
-        vector<DataPoint> leftSplit, rightSplit;
-        for (const auto& dp : data) {
-            if ((attribute == "gender" && dp.gender == value) ||
-                (attribute == "deviceType" && dp.deviceType == value) ||
-                (attribute == "adPosition" && dp.adPosition == value) ||
-                (attribute == "browsingHistory" && dp.browsingHistory == value) ||
-                (attribute == "timeOfDay" && dp.timeOfDay == value)) {
-                leftSplit.push_back(dp);
-            }
-            else {
-                rightSplit.push_back(dp);
-            }
+    double pClick = static_cast<double>(clicks) / total;
+    double pNoClick = 1.0 - pClick;
+
+    return 1.0 - (pClick * pClick + pNoClick * pNoClick);
+}
+
+// Scores every (attribute == code) candidate from per-category counts
+void scoreSplitCandidates(int attribute, const vector<int64_t>& rowCounts, const vector<int64_t>& clickCounts,
+    int64_t total, int64_t totalClicks, SplitCandidate& best, int minSamplesLeaf) {
+    size_t missingBucket = rowCounts.size() - 1;
+
+    // Each present category is a candidate: rows with the value go left, the rest go right
+    for (size_t bucket = 0; bucket < rowCounts.size(); ++bucket) {
+        int64_t leftCount = rowCounts[bucket];
+        int64_t rightCount = total - leftCount;
+        if (leftCount == 0) continue;
+        if (rightCount > 0 && (leftCount < minSamplesLeaf || rightCount < minSamplesLeaf)) continue;
+
+        int64_t leftClicks = clickCounts[bucket];
+        double gini = (static_cast<double>(leftCount) / total) * giniFromCounts(leftCount, leftClicks) +
+            (static_cast<double>(rightCount) / total) * giniFromCounts(rightCount, totalClicks - leftClicks);
+
+        if (gini < best.gini) {
+            best.gini = gini;
+            best.attribute = attribute;
+            best.value = bucket == missingBucket ? MISSING_CODE : static_cast<CategoryCode>(bucket);
+            best.separates = rightCount > 0;
         }
-        return { leftSplit, rightSplit };
     }
+}
 
-    // Build a decision tree
-    TreeNode* buildDecisionTree(vector<DataPoint>& data, const vector<string>& attributes) {
-        if (data.empty()) return nullptr;
+// Scores every (feature <= threshold) candidate from cumulative per-bin counts
+void scoreThresholdCandidates(int feature, const vector<int>& upperBounds, const vector<int64_t>& rowCounts,
+    const vector<int64_t>& clickCounts, int64_t total, int64_t totalClicks, SplitCandidate& best, int minSamplesLeaf) {
+    int64_t leftCount = 0, leftClicks = 0;
 
-        // Check if all data points have the same target value
-        bool allSame = true;
-        int firstClick = data[0].click;
-        for (const auto& point : data) {
-            if (point.click != firstClick) {
-                allSame = false;
-                break;
-            }
-        }
+    // Splitting after the last bin would send every row left
+    for (size_t bin = 0; bin + 1 < upperBounds.size(); ++bin) {
+        leftCount += rowCounts[bin];
+        leftClicks += clickCounts[bin];
+        int64_t rightCount = total - leftCount;
+        if (leftCount == 0 || rightCount == 0) continue;
+        if (leftCount < minSamplesLeaf || rightCount < minSamplesLeaf) continue;
 
-        if (allSame) {
-            TreeNode* leaf = new TreeNode();
-            leaf->prediction = firstClick;
-            return leaf;
-        }
+        // Thresholds are stored in the node's code field
+        int threshold = upperBounds[bin];
+        if (threshold < 0 || threshold >= MISSING_CODE) continue;
 
-        if (attributes.empty()) {
-            // Majority class leaf node
-            int countClick = count_if(data.begin(), data.end(), [](const DataPoint& dp) { return dp.click == 1; });
-            TreeNode* leaf = new TreeNode();
-            leaf->prediction = (countClick >= data.size() / 2) ? 1 : 0;
-            return leaf;
+        double gini = (static_cast<double>(leftCount) / total) * giniFromCounts(leftCount, leftClicks) +
+            (static_cast<double>(rightCount) / total) * giniFromCounts(rightCount, totalClicks - leftClicks);
+
+        if (gini < best.gini) {
+            best.gini = gini;
+            best.attribute = feature;
+            best.value = static_cast<CategoryCode>(threshold);
+            best.separates = true;
         }
+    }
+}
 
-        // Find the best split
-        double bestGini = 1.0;
-        string bestAttribute, bestValue;
-        vector<DataPoint> bestLeftSplit, bestRightSplit;
+void NumericBins::build(const int* values, size_t n, size_t maxBins) {
+    upperBounds.clear();
+    codes.assign(n, 0);
+    if (n == 0) return;
 
-        for (const auto& attr : attributes) {
-            vector<string> uniqueValues;
-            for (const auto& point : data) {
-                if (attr == "gender") uniqueValues.push_back(point.gender);
-                else if (attr == "deviceType") uniqueValues.push_back(point.deviceType);
-                else if (attr == "adPosition") uniqueValues.push_back(point.adPosition);
-                else if (attr == "browsingHistory") uniqueValues.push_back(point.browsingHistory);
-                else if (attr == "timeOfDay") uniqueValues.push_back(point.timeOfDay);
-            }
-            sort(uniqueValues.begin(), uniqueValues.end());
-            uniqueValues.erase(unique(uniqueValues.begin(), uniqueValues.end()), uniqueValues.end());
-
-            for (const auto& value : uniqueValues) {
-                auto splitResult = splitData(data, attr, value);
-                auto& leftSplit = splitResult.first;
-                auto& rightSplit = splitResult.second;
-
-                double gini = (static_cast<double>(leftSplit.size()) / data.size()) * calculateGini(leftSplit) +
-                    (static_cast<double>(rightSplit.size()) / data.size()) * calculateGini(rightSplit);
-
-                if (gini < bestGini) {
-                    bestGini = gini;
-                    bestAttribute = attr;
-                    bestValue = value;
-                    bestLeftSplit = leftSplit;
-                    bestRightSplit = rightSplit;
-                }
+    vector<int> sorted(values, values + n);
+    sort(sorted.begin(), sorted.end());
+
+    // Quantile bin edges; repeated values collapse into one bin. Small datasets get one bin
+    // per row at most, so every edge index is valid.
+    maxBins = min<size_t>(min<size_t>(maxBins, 256), n);
+    for (size_t b = 1; b <= maxBins; ++b) {
+        int bound = sorted[b * n / maxBins - 1];
+        if (upperBounds.empty() || bound > upperBounds.back()) upperBounds.push_back(bound);
+    }
+
+    for (size_t r = 0; r < n; ++r) {
+        codes[r] = static_cast<uint8_t>(lower_bound(upperBounds.begin(), upperBounds.end(), values[r]) - upperBounds.begin());
+    }
+}
+
+// Find the best split using one counting pass per attribute
+SplitCandidate findBestSplit(const EncodedDataset& data, const vector<uint32_t>& weights,
+    const RowIndex* first, const RowIndex* last, const vector<int>& attributes, const NumericBins* ageBins,
+    int minSamplesLeaf) {
+    SplitCandidate best;
+    const int* clicks = data.clickColumn();
+
+    int64_t total = 0, totalClicks = 0;
+    for (const RowIndex* it = first; it != last; ++it) {
+        total += weights[*it];
+        totalClicks += clicks[*it] == 1 ? weights[*it] : 0;
+    }
+
+    vector<int64_t> rowCounts, clickCounts;
+    for (int attr : attributes) {
+        if (attr == FEATURE_AGE) {
+            if (!ageBins) continue;
+
+            // Per-bin counts; thresholds come from the cumulative sums
+            size_t numBins = ageBins->upperBounds.size();
+            rowCounts.assign(numBins, 0);
+            clickCounts.assign(numBins, 0);
+            for (const RowIndex* it = first; it != last; ++it) {
+                uint8_t bin = ageBins->codes[*it];
+                rowCounts[bin] += weights[*it];
+                clickCounts[bin] += clicks[*it] == 1 ? weights[*it] : 0;
             }
+
+            scoreThresholdCandidates(attr, ageBins->upperBounds, rowCounts, clickCounts, total, totalClicks, best, minSamplesLeaf);
+            continue;
         }
 
-        if (bestLeftSplit.empty() || bestRightSplit.empty()) {
-            TreeNode* leaf = new TreeNode();
-            leaf->prediction = count_if(data.begin(), data.end(), [](const DataPoint& dp) { return dp.click == 1; }) >= data.size() / 2 ? 1 : 0;
-            return leaf;
+        const CategoryCode* codes = data.column(attr);
+
+        // One bucket per dictionary code plus a final bucket for missing values
+        size_t missingBucket = data.getSchema().dictionary(attr).size();
+        rowCounts.assign(missingBucket + 1, 0);
+        clickCounts.assign(missingBucket + 1, 0);
+
+        for (const RowIndex* it = first; it != last; ++it) {
+            size_t bucket = codes[*it] == MISSING_CODE ? missingBucket : codes[*it];
+            rowCounts[bucket] += weights[*it];
+            clickCounts[bucket] += clicks[*it] == 1 ? weights[*it] : 0;
         }
 
-        TreeNode* root = new TreeNode();
-        root->splitAttribute = bestAttribute;
-        root->splitValue = bestValue;
-        root->left = buildDecisionTree(bestLeftSplit, attributes);
-        root->right = buildDecisionTree(bestRightSplit, attributes);
+        scoreSplitCandidates(attr, rowCounts, clickCounts, total, totalClicks, best, minSamplesLeaf);
+    }
+
+    // A winning candidate that puts every row on one side does not split the node
+    if (!best.separates) return SplitCandidate();
+    return best;
+}
 
-        return root;
+// Reorder rows so that rows going left come first
+RowIndex* partitionRows(const EncodedDataset& data, RowIndex* first, RowIndex* last, int attribute, CategoryCode value) {
+    if (attribute == FEATURE_AGE) {
+        const int* ages = data.ageColumn();
+        int threshold = value;
+        return partition(first, last, [ages, threshold](RowIndex r) { return ages[r] <= threshold; });
     }
 
-    // Predict using a single tree
-    int predictTree(TreeNode* node, const DataPoint& point) {
-        if (!node->left && !node->right) return node->prediction;
+    const CategoryCode* codes = data.column(attribute);
+    return partition(first, last, [codes, value](RowIndex r) { return codes[r] == value; });
+}
 
-        if ((node->splitAttribute == "gender" && point.gender == node->splitValue) ||
-            (node->splitAttribute == "deviceType" && point.deviceType == node->splitValue) ||
-            (node->splitAttribute == "adPosition" && point.adPosition == node->splitValue) ||
-            (node->splitAttribute == "browsingHistory" && point.browsingHistory == node->splitValue) ||
-            (node->splitAttribute == "timeOfDay" && point.timeOfDay == node->splitValue)) {
-            return predictTree(node->left, point);
-        }
-        else {
-            return predictTree(node->right, point);
+// Build a decision tree level by level. The open nodes of a level own consecutive ranges of
+// the partitioned rows, so each level is one pass over the sample.
+TreeNode* buildDecisionTree(const EncodedDataset& data, const vector<uint32_t>& weights,
+    RowIndex* first, RowIndex* last, const vector<int>& attributes, TreeArena& arena,
+    const NumericBins* ageBins, const TreeLimits& limits) {
+    if (first == last) return nullptr;
+
+    struct OpenNode {
+        TreeNode* node;
+        RowIndex* first;
+        RowIndex* last;
+    };
+
+    const int* clicks = data.clickColumn();
+    TreeNode* root = arena.allocate();
+    vector<OpenNode> level = { { root, first, last } }, nextLevel;
+    int numNodes = 1;
+
+    for (int depth = 0; !level.empty(); ++depth) {
+        nextLevel.clear();
+        for (const OpenNode& open : level) {
+            TreeNode* node = open.node;
+
+            // Weighted row and click counts of this node
+            int64_t total = 0, countClick = 0;
+            for (RowIndex* it = open.first; it != open.last; ++it) {
+                total += weights[*it];
+                countClick += clicks[*it] == 1 ? weights[*it] : 0;
+            }
+            node->prediction = (countClick >= total / 2) ? 1 : 0; // Majority class unless split below
+            node->clickRate = static_cast<float>(countClick) / total;
+
+            // Pure nodes, nodes at the depth limit and nodes without attributes stay leaves
+            if (countClick == 0 || countClick == total) {
+                node->prediction = countClick > 0 ? 1 : 0;
+                continue;
+            }
+            if (attributes.empty() || (limits.maxDepth > 0 && depth >= limits.maxDepth)) continue;
+            if (limits.maxNodes > 0 && numNodes + 2 > limits.maxNodes) continue;
+
+            // Find the best split from per-category and per-bin counts, then partition the rows in place
+            SplitCandidate best = findBestSplit(data, weights, open.first, open.last, attributes, ageBins, limits.minSamplesLeaf);
+            if (best.attribute < 0) continue;
+            if (giniFromCounts(total, countClick) - best.gini < limits.minImpurityDecrease) continue;
+
+            RowIndex* middle = partitionRows(data, open.first, open.last, best.attribute, best.value);
+
+            node->prediction = -1;
+            node->clickRate = 0;
+            node->splitAttribute = best.attribute;
+            node->splitValue = best.value;
+            node->left = arena.allocate();
+            node->right = arena.allocate();
+            numNodes += 2;
+            nextLevel.push_back({ node->left, open.first, middle });
+            nextLevel.push_back({ node->right, middle, open.last });
         }
+        level.swap(nextLevel);
     }
 
+    return root;
+}
+
+// Leaf of a tree reached by a row
+static const TreeNode* leafOf(const TreeNode* node, const EncodedRow& point) {
+    while (node->left || node->right) {
+        int x = point.feature(node->splitAttribute);
+        bool goesLeft = node->splitAttribute < NUM_CATEGORICAL ? x == node->splitValue : x <= node->splitValue;
+        node = goesLeft ? node->left : node->right;
+    }
+    return node;
+}
+
+// Predict using a single tree
+int predictTree(TreeNode* node, const EncodedRow& point) {
+    return leafOf(node, point)->prediction;
+}
+
+// Replaces the split codes of a tree using per-column code maps (numeric thresholds are kept)
+static void remapTree(TreeNode* node, const vector<CategoryCode> codeMap[NUM_CATEGORICAL]) {
+    if (!node || node->splitAttribute < 0) return;
+    if (node->splitAttribute < NUM_CATEGORICAL && node->splitValue != MISSING_CODE) node->splitValue = codeMap[node->splitAttribute][node->splitValue];
+    remapTree(node->left, codeMap);
+    remapTree(node->right, codeMap);
+}
+
+// Model file layout: ModelHeader, then the payload it describes: the dictionaries, the
+// root index of each tree, and the CompiledNode array, each padded to 8 bytes
+struct ModelHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t numTrees;
+    uint64_t numNodes;
+    uint64_t payloadBytes;
+    uint64_t checksum;    // FNV-1a of the header (with this field zero), then the payload
+    uint32_t numColumns;
+    uint32_t nodeBytes;   // sizeof(CompiledNode), guards against layout changes
+};
+
+static const char MODEL_MAGIC[4] = { 'A', 'D', 'S', 'M' };
+static const uint32_t MODEL_VERSION = 3;  // 2: leaves store their click rate; 3: checksum covers the header
+
+static uint64_t modelChecksum(ModelHeader header, const char* payload, size_t payloadBytes) {
+    header.checksum = 0;
+    return fnv1a(payload, payloadBytes, fnv1a(reinterpret_cast<const char*>(&header), sizeof(header)));
+}
+
+namespace std {
+
     // Random forest class
-    RandomForest::RandomForest(int n) : numTrees(n) {}
+    RandomForest::RandomForest(int n) : numTrees(n), numThreads(0), seed(random_device{}()) {}
 
     void RandomForest::train(const vector<DataPoint>& data, const vector<string>& attributes) {
-        mt19937 rng(random_device{}());
-        for (int i = 0; i < numTrees; ++i) {
-            vector<DataPoint> sample;
-            for (size_t j = 0; j < data.size(); ++j) {
-                sample.push_back(data[rng() % data.size()]);
-            }
+        train(EncodedDataset(data), attributes);
+    }
 
-            vector<string> selectedAttributes = attributes;
+    void RandomForest::train(const EncodedDataset& data, const vector<string>& attributes) {
+        vector<RowIndex> rows(data.size());
+        for (size_t r = 0; r < rows.size(); ++r) {
+            rows[r] = static_cast<RowIndex>(r);
+        }
+        train(data, rows, attributes);
+    }
+
+    void RandomForest::train(const EncodedDataset& data, const vector<RowIndex>& rows, const vector<string>& attributes) {
+        // Resolve attribute names to features once; unknown attributes are not split on
+        vector<int> columns;
+        for (const auto& attr : attributes) {
+            int feature = featureIndex(attr);
+            if (feature >= 0) columns.push_back(feature);
+        }
+
+        // Age thresholds are scored from quantile bins shared by every tree. The bins only depend
+        // on the ages, so they are taken over the whole dataset even when training on a subset.
+        NumericBins ageBins;
+        bool useAge = find(columns.begin(), columns.end(), FEATURE_AGE) != columns.end();
+        if (useAge) ageBins.build(data.ageColumn(), data.size());
+
+        // Trees added by later calls continue the per-tree RNG streams instead of repeating them
+        ensureTrees();
+        size_t firstTree = trees.size();
+        vector<DecisionTree> newTrees(numTrees);
+
+        mutex progressMutex;
+        int treesDone = 0;
+
+        // Out-of-bag votes, trees and summed click rates of every row, added as trees finish
+        vector<uint32_t> oobVotes(data.size(), 0), oobTrees(data.size(), 0);
+        vector<double> oobRates(data.size(), 0.0);
+
+        ThreadPool pool(numThreads);
+        pool.parallelFor(numTrees, [&](size_t i) {
+            // Each tree has its own RNG stream so the forest does not depend on the thread count
+            seed_seq treeSeed{ seed, static_cast<uint32_t>(firstTree + i) };
+            mt19937 rng(treeSeed);
+
+            BootstrapSample sample = drawBootstrap(rows, data.size(), rng);
+
+            vector<int> selectedAttributes = columns;
             shuffle(selectedAttributes.begin(), selectedAttributes.end(), rng);
-            selectedAttributes.resize(3); // Choose a subset of attributes
+            selectedAttributes.resize(min<size_t>(3, selectedAttributes.size())); // Choose a subset of attributes
 
-            trees.push_back(buildDecisionTree(sample, selectedAttributes));
+            RowIndex* sampleRows = sample.rows.data();
+            newTrees[i].root = buildDecisionTree(data, sample.weights, sampleRows, sampleRows + sample.rows.size(), selectedAttributes, newTrees[i].arena,
+                useAge ? &ageBins : nullptr, limits);
+
+            // Score the rows this tree's bootstrap left out (weight 0) before taking the lock
+            vector<const TreeNode*> oobLeaves;
+            for (RowIndex r : rows) {
+                if (sample.weights[r] == 0) oobLeaves.push_back(leafOf(newTrees[i].root, data.row(r)));
+            }
+
+            lock_guard<mutex> lock(progressMutex);
+            auto leaf = oobLeaves.begin();
+            for (RowIndex r : rows) {
+                if (sample.weights[r] != 0) continue;
+                oobVotes[r] += (*leaf)->prediction;
+                oobTrees[r]++;
+                oobRates[r] += (*leaf)->clickRate;
+                ++leaf;
+            }
 
             // Display progress after each tree is built
-            double progress = static_cast<double>(i + 1) / numTrees * 100;
-            std::cout << "Training progress: " << progress << "% (" << i + 1 << " out of " << numTrees << " trees trained)\r";
+            treesDone++;
+            if (!showProgress) return;
+            double progress = static_cast<double>(treesDone) / numTrees * 100;
+            std::cout << "Training progress: " << progress << "% (" << treesDone << " out of " << numTrees << " trees trained)\r";
             std::cout.flush();
+        });
+        if (showProgress) std::cout << std::endl; // Move to the next line after progress display
+
+        // Rows kept by every bootstrap have no out-of-bag trees and are not counted
+        const int* clicks = data.clickColumn();
+        oob = OobEstimate();
+        size_t correct = 0;
+        for (RowIndex r : rows) {
+            if (oobTrees[r] == 0) continue;
+            int prediction = (oobVotes[r] > oobTrees[r] / 2) ? 1 : 0;
+            double p = min(max(oobRates[r] / oobTrees[r], 1e-15), 1.0 - 1e-15);
+            correct += prediction == clicks[r] ? 1 : 0;
+            oob.logLoss -= clicks[r] == 1 ? log(p) : log(1.0 - p);
+            oob.rows++;
+        }
+        if (oob.rows > 0) {
+            oob.accuracy = static_cast<double>(correct) / oob.rows;
+            oob.logLoss /= oob.rows;
+        }
+
+        addTrees(move(newTrees), data.getSchema());
+    }
+
+    void RandomForest::addTrees(vector<DecisionTree>&& newTrees, const DatasetSchema& trainedSchema) {
+        ensureTrees();
+        if (trees.empty()) {
+            schema = trainedSchema;
+        }
+        else {
+            // Extend the forest's dictionaries with the new values (existing codes are unchanged)
+            // and translate the new trees' split codes to them
+            vector<CategoryCode> codeMap[NUM_CATEGORICAL];
+            for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+                const CategoryDictionary& source = trainedSchema.dictionary(c);
+                for (size_t code = 0; code < source.size(); ++code) {
+                    codeMap[c].push_back(schema.dictionary(c).encode(source.decode(static_cast<CategoryCode>(code))));
+                }
+            }
+            for (const auto& tree : newTrees) {
+                remapTree(tree.root, codeMap);
+            }
+        }
+        for (auto& tree : newTrees) {
+            trees.push_back(move(tree));
+        }
+        compile();
+    }
+
+    void RandomForest::retireOldestTrees(size_t count) {
+        ensureTrees();
+        count = min(count, trees.size());
+        trees.erase(trees.begin(), trees.begin() + count);
+        compile();
+    }
+
+    void RandomForest::refitLeaves(const EncodedDataset& window) {
+        vector<CategoryCode> recoded[NUM_CATEGORICAL];
+        EncodedBatch batch = window.recodedBatch(schema, recoded);
+        const int* clicks = window.clickColumn();
+
+        // Row and click counts of every node; each tree only touches its own nodes
+        vector<uint32_t> totals(compiled.numNodes(), 0);
+        vector<uint32_t> clickCounts(compiled.numNodes(), 0);
+        ThreadPool pool(numThreads);
+        pool.parallelFor(compiled.numTrees(), [&](size_t t) {
+            for (size_t r = 0; r < batch.size; ++r) {
+                uint32_t leaf = compiled.leafIndex(t, batch, r);
+                totals[leaf]++;
+                clickCounts[leaf] += clicks[r] == 1 ? 1 : 0;
+            }
+        });
+
+        // Same majority rule as buildDecisionTree
+        CompiledNode* nodes = compiled.mutableNodeData();
+        for (size_t n = 0; n < compiled.numNodes(); ++n) {
+            if (nodes[n].feature < 0 && totals[n] > 0) {
+                nodes[n].prediction = clickCounts[n] >= totals[n] / 2 ? 1 : 0;
+                nodes[n].clickRate = static_cast<float>(clickCounts[n]) / totals[n];
+            }
+        }
+
+        // The compiled arrays are now the model; ensureTrees rebuilds pointer trees from them
+        trees.clear();
+        lookupTable.clear();
+    }
+
+    void RandomForest::slideWindow(const EncodedDataset& window, const vector<string>& attributes, size_t maxTrees) {
+        train(window, attributes);
+        if (static_cast<size_t>(getNumTrees()) > maxTrees) {
+            retireOldestTrees(getNumTrees() - maxTrees);
+        }
+    }
+
+    void RandomForest::ensureTrees() {
+        if (trees.empty() && compiled.numTrees() > 0) {
+            trees = compiled.decompile();
+        }
+    }
+
+    bool RandomForest::save(const string& path) const {
+        string payload;
+        schema.serialize(payload);
+        appendBytes(payload, compiled.rootData(), compiled.numTrees() * sizeof(uint32_t));
+        padTo8(payload);
+        appendBytes(payload, compiled.nodeData(), compiled.numNodes() * sizeof(CompiledNode));
+        padTo8(payload);
+
+        ModelHeader header = {};
+        memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+        header.version = MODEL_VERSION;
+        header.numTrees = compiled.numTrees();
+        header.numNodes = compiled.numNodes();
+        header.payloadBytes = payload.size();
+        header.numColumns = NUM_CATEGORICAL;
+        header.nodeBytes = sizeof(CompiledNode);
+        header.checksum = modelChecksum(header, payload.data(), payload.size());
+
+        // Written under a temporary name and renamed, so readers never map a partial model
+        return writeFileAtomically(path, header, payload);
+    }
+
+    bool RandomForest::load(const string& path) {
+        auto file = make_shared<MappedFile>();
+        if (!file->open(path) || file->size() < sizeof(ModelHeader)) return false;
+
+        ModelHeader header;
+        memcpy(&header, file->data(), sizeof(header));
+        if (memcmp(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0 || header.version != MODEL_VERSION ||
+            header.numColumns != NUM_CATEGORICAL || header.nodeBytes != sizeof(CompiledNode) ||
+            header.payloadBytes != file->size() - sizeof(ModelHeader)) {
+            return false;
+        }
+
+        const char* payload = file->data() + sizeof(ModelHeader);
+        if (modelChecksum(header, payload, header.payloadBytes) != header.checksum) return false;
+
+        // Bound the counts by the payload before sizing arrays with them
+        if (header.numTrees > header.payloadBytes / sizeof(uint32_t) ||
+            header.numNodes > header.payloadBytes / sizeof(CompiledNode)) {
+            return false;
+        }
+
+        PayloadReader reader = { payload, payload + header.payloadBytes };
+        DatasetSchema loadedSchema;
+        if (!loadedSchema.deserialize(reader)) return false;
+
+        const uint32_t* rootArray = reinterpret_cast<const uint32_t*>(reader.take(header.numTrees * sizeof(uint32_t)));
+        const CompiledNode* nodeArray = reinterpret_cast<const CompiledNode*>(reader.take(header.numNodes * sizeof(CompiledNode)));
+        if (!rootArray || !nodeArray) return false;
+
+        // Children always follow their parent, so checking that also rules out cycles
+        for (size_t t = 0; t < header.numTrees; ++t) {
+            if (rootArray[t] >= header.numNodes) return false;
+        }
+        for (size_t n = 0; n < header.numNodes; ++n) {
+            const CompiledNode& node = nodeArray[n];
+            if (node.feature >= NUM_FEATURES) return false;
+            if (node.feature >= 0 && (node.firstChild <= n || static_cast<uint64_t>(node.firstChild) + 1 >= header.numNodes)) return false;
         }
-        std::cout << std::endl; // Move to the next line after progress display
+
+        trees.clear();
+        schema = loadedSchema;
+        numTrees = static_cast<int>(header.numTrees);
+        compiled.mapFrom(file, nodeArray, header.numNodes, rootArray, header.numTrees);
+        lookupTable.clear();
+        return true;
+    }
+
+    void RandomForest::compile() {
+        compiled.compile(trees);
+        lookupTable.clear();
+    }
+
+    bool RandomForest::buildLookupTable(size_t maxEntries) {
+        return lookupTable.build(compiled, schema, maxEntries);
     }
 
     int RandomForest::predict(const DataPoint& point) {
-        vector<int> predictions;
-        for (const auto& tree : trees) {
-            predictions.push_back(predictTree(tree, point));
+        return predict(schema.encodeRow(point));
+    }
+
+    int RandomForest::predict(const EncodedRow& point) const {
+        int ones = lookupTable.empty() ? compiled.votes(point) : lookupTable.lookup(point);
+        return (ones > compiled.numTrees() / 2) ? 1 : 0;
+    }
+
+    double RandomForest::predictProbability(const DataPoint& point) const {
+        return predictProbability(schema.encodeRow(point));
+    }
+
+    double RandomForest::predictProbability(const EncodedRow& point) const {
+        return lookupTable.empty() ? compiled.clickRate(point) : lookupTable.lookupRate(point);
+    }
+
+    void RandomForest::predictBatch(const EncodedBatch& batch, int* predictions, double* probabilities) const {
+        const size_t blockSize = 1024;        // Rows scored per tree pass; keeps votes and codes in L1
+        const size_t parallelThreshold = 16 * blockSize;
+
+        size_t numBlocks = (batch.size + blockSize - 1) / blockSize;
+        size_t treeCount = compiled.numTrees();
+
+        auto scoreBlock = [&](size_t b) {
+            size_t first = b * blockSize;
+            EncodedBatch block = batch.slice(first, min(blockSize, batch.size - first));
+
+            uint32_t votes[blockSize] = {};
+            float rates[blockSize] = {};
+            float* rateOut = probabilities ? rates : nullptr;
+            double rateScale = 1.0;  // Trees add up their leaf rates; the table already holds the mean
+            if (lookupTable.empty()) {
+                compiled.accumulateVotes(block, votes, rateOut);
+                rateScale = treeCount > 0 ? 1.0 / treeCount : 0.0;
+            }
+            else {
+                lookupTable.lookupBatch(block, votes, rateOut);
+            }
+
+            for (size_t r = 0; r < block.size; ++r) {
+                if (predictions) predictions[first + r] = (votes[r] > treeCount / 2) ? 1 : 0;
+                if (probabilities) probabilities[first + r] = rates[r] * rateScale;
+            }
+        };
+
+        if (batch.size < parallelThreshold) {
+            for (size_t b = 0; b < numBlocks; ++b) {
+                scoreBlock(b);
+            }
+            return;
+        }
+
+        ThreadPool pool(numThreads);
+        pool.parallelFor(numBlocks, scoreBlock);
+    }
+
+    void RandomForest::predictSweep(const EncodedBatch& batch, int column, const vector<CategoryCode>& values,
+        int* predictions, double* probabilities) const {
+        const size_t blockSize = 256;
+        const size_t parallelThreshold = 16 * blockSize;
+
+        size_t count = values.size();
+        size_t numBlocks = (batch.size + blockSize - 1) / blockSize;
+        size_t treeCount = compiled.numTrees();
+
+        auto scoreBlock = [&](size_t b) {
+            size_t first = b * blockSize;
+            EncodedBatch block = batch.slice(first, min(blockSize, batch.size - first));
+
+            vector<uint32_t> votes(block.size * count, 0);
+            vector<float> rates(block.size * count, 0.0f);
+            double rateScale = 1.0;
+            if (lookupTable.empty()) {
+                compiled.accumulateSweep(block, column, values.data(), count, votes.data(), probabilities ? rates.data() : nullptr);
+                rateScale = treeCount > 0 ? 1.0 / treeCount : 0.0;
+            }
+            else {
+                // The table answers each candidate with one read
+                for (size_t r = 0; r < block.size; ++r) {
+                    EncodedRow row;
+                    row.age = block.ages[r];
+                    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+                        row.codes[c] = block.columns[c][r];
+                    }
+                    for (size_t i = 0; i < count; ++i) {
+                        row.codes[column] = values[i];
+                        votes[i * block.size + r] = lookupTable.lookup(row);
+                        rates[i * block.size + r] = static_cast<float>(lookupTable.lookupRate(row));
+                    }
+                }
+            }
+
+            // Kernels write candidate-major; outputs are row-major
+            for (size_t r = 0; r < block.size; ++r) {
+                for (size_t i = 0; i < count; ++i) {
+                    size_t in = i * block.size + r, out = (first + r) * count + i;
+                    if (predictions) predictions[out] = (votes[in] > treeCount / 2) ? 1 : 0;
+                    if (probabilities) probabilities[out] = rates[in] * rateScale;
+                }
+            }
+        };
+
+        if (batch.size < parallelThreshold) {
+            for (size_t b = 0; b < numBlocks; ++b) {
+                scoreBlock(b);
+            }
+            return;
         }
 
-        int ones = count(predictions.begin(), predictions.end(), 1);
-        return (ones > predictions.size() / 2) ? 1 : 0;
+        ThreadPool pool(numThreads);
+        pool.parallelFor(numBlocks, scoreBlock);
     }
 
     int RandomForest::predictWithTree(const DataPoint& point, int treeIndex) const {
-        if (treeIndex < 0 || treeIndex >= trees.size()) {
+        if (treeIndex < 0 || treeIndex >= compiled.numTrees()) {
             cerr << "Error: Tree index out of range!" << endl;
             return -1; // Indicating an invalid prediction
         }
-        return predictTree(trees[treeIndex], point);
+        return compiled.predictTree(treeIndex, schema.encodeRow(point));
     }
 
 } // namespace std
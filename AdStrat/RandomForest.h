@@ -6,50 +6,205 @@
 #include <random>
 #include <algorithm>
 #include <map>
+#include <cstdint>
 #include "ImportedData.h"
+#include "EncodedDataset.h"
+#include "CompiledForest.h"
+#include "DecisionTree.h"
+#include "ForestLookupTable.h"
 #include "global.h"
 
-namespace std {
-    // Define the structure for decision tree nodes
-    struct TreeNode {
-        string splitAttribute;
-        string splitValue;
-        TreeNode* left = nullptr;
-        TreeNode* right = nullptr;
-        int prediction = -1; // -1 for non-leaf nodes, 0 or 1 for leaf nodes
-    };
+using namespace std;
+
+// Bootstrap sample stored as row indices and draw counts instead of copied rows
+struct BootstrapSample {
+    vector<RowIndex> rows;    // Distinct rows drawn at least once; partitioned in place while a tree grows
+    vector<uint32_t> weights; // Times each dataset row was drawn (0 = out of bag)
+};
+
+// Draw a bootstrap sample of size n with replacement
+BootstrapSample drawBootstrap(size_t n, mt19937& rng);
+
+// Draw a bootstrap sample of size rows.size() from the given rows of a dataset with
+// datasetSize rows; rows left out of the subset get weight 0 too
+BootstrapSample drawBootstrap(const vector<RowIndex>& rows, size_t datasetSize, mt19937& rng);
+
+// Quantile bins of a numeric column, computed once per dataset so that threshold candidates
+// are scored from cumulative bin counts instead of sorting the rows of every node
+struct NumericBins {
+    vector<int> upperBounds;  // Largest value of each bin, ascending
+    vector<uint8_t> codes;    // Bin of each dataset row
+
+    // Splits values into at most maxBins (<= 256, <= n) bins holding roughly equal numbers of rows
+    void build(const int* values, size_t n, size_t maxBins = 64);
+};
+
+// Growth limits of a tree; 0 disables maxDepth and maxNodes
+struct TreeLimits {
+    int maxDepth = 0;                  // Nodes at this depth become leaves (the root has depth 0)
+    int minSamplesLeaf = 1;            // Weighted rows each child of a split must receive
+    double minImpurityDecrease = 0.0;  // Gini decrease over its node a split must achieve
+    int maxNodes = 0;                  // Nodes per tree; levels are filled in order until it is reached
+};
+
+// Candidate split produced by findBestSplit (attribute is -1 when no split separates the rows)
+struct SplitCandidate {
+    int attribute = -1;
+    CategoryCode value = MISSING_CODE; // Code for categorical features, threshold for numeric ones
+    double gini = 1.0;
+    bool separates = false; // False when the candidate sends every row to one side
+};
 
-    // Function to calculate Gini Impurity for a split
-    double calculateGini(const vector<DataPoint>& data);
+// Gini Impurity of a group from its click counts. Counts are 64-bit: streamed training sums
+// bootstrap weights over files of any size.
+double giniFromCounts(int64_t total, int64_t clicks);
 
-    // Split data based on an attribute and value
-    pair<vector<DataPoint>, vector<DataPoint>> splitData(
-        const vector<DataPoint>& data,
-        const string& attribute,
-        const string& value);
+// Scores every (attribute == code) candidate from per-category row and click counts (one
+// bucket per dictionary code, then one for MISSING_CODE), keeping the lowest Gini in best.
+// Candidates leaving fewer than minSamplesLeaf rows on a side are skipped.
+void scoreSplitCandidates(int attribute, const vector<int64_t>& rowCounts, const vector<int64_t>& clickCounts,
+    int64_t total, int64_t totalClicks, SplitCandidate& best, int minSamplesLeaf = 1);
 
-    // Build a decision tree
-    TreeNode* buildDecisionTree(vector<DataPoint>& data, const vector<string>& attributes);
+// Scores every (feature <= upperBounds[b]) candidate from per-bin row and click counts,
+// keeping the lowest Gini in best
+void scoreThresholdCandidates(int feature, const vector<int>& upperBounds, const vector<int64_t>& rowCounts,
+    const vector<int64_t>& clickCounts, int64_t total, int64_t totalClicks, SplitCandidate& best, int minSamplesLeaf = 1);
 
-    // Predict using a single tree
-    int predictTree(TreeNode* node, const DataPoint& point);
+// Find the best split of the weighted rows [first, last) from per-category (and, for age,
+// per-bin) click counts. FEATURE_AGE is only considered when ageBins is given.
+SplitCandidate findBestSplit(const EncodedDataset& data, const vector<uint32_t>& weights,
+    const RowIndex* first, const RowIndex* last, const vector<int>& attributes,
+    const NumericBins* ageBins = nullptr, int minSamplesLeaf = 1);
 
-    // Random forest class
+// Reorder [first, last) so rows going left (attribute == value, or <= value for numeric
+// features) come first; returns the end of that group
+RowIndex* partitionRows(const EncodedDataset& data, RowIndex* first, RowIndex* last, int attribute, CategoryCode value);
+
+// Build a decision tree over the weighted rows [first, last), partitioning them in place and
+// allocating its nodes from arena. The tree grows one level at a time within limits.
+TreeNode* buildDecisionTree(const EncodedDataset& data, const vector<uint32_t>& weights,
+    RowIndex* first, RowIndex* last, const vector<int>& attributes, TreeArena& arena,
+    const NumericBins* ageBins = nullptr, const TreeLimits& limits = TreeLimits());
+
+// Predict using a single tree
+int predictTree(TreeNode* node, const EncodedRow& point);
+
+// Out-of-bag estimate of a train call: each row is scored only by the trees whose bootstrap
+// sample left it out
+struct OobEstimate {
+    size_t rows = 0;        // Rows left out by at least one tree
+    double accuracy = 0.0;  // Fraction of those rows whose out-of-bag majority vote is right
+    double logLoss = 0.0;   // Mean log-loss of their out-of-bag click probability
+};
+
+namespace std {
+
+    // Random forest class. The forest owns its trees, so it can be moved but not copied.
     class RandomForest {
         int numTrees;
-        vector<TreeNode*> trees;
+        int numThreads;   // Threads used by train (0 = hardware concurrency)
+        uint32_t seed;    // Per-tree RNG streams are derived from this seed
+        TreeLimits limits; // Growth limits of trees trained from now on
+        OobEstimate oob;   // Out-of-bag estimate of the last train call
+        bool showProgress = true; // Print training progress to cout
+        vector<DecisionTree> trees;
+        CompiledForest compiled; // Flattened copy of trees used by predict
+        ForestLookupTable lookupTable; // Optional precomputed votes; used by predict when built
+        DatasetSchema schema; // Dictionaries of the training data, used to encode prediction inputs
+
+        // Rebuilds the pointer trees of a forest loaded from a model file before it is trained further
+        void ensureTrees();
 
     public:
         RandomForest(int n); // Constructor
 
-        // Train the Random Forest model
+        RandomForest(RandomForest&&) = default;
+        RandomForest& operator=(RandomForest&&) = default;
+        RandomForest(const RandomForest&) = delete;
+        RandomForest& operator=(const RandomForest&) = delete;
+
+        // Training configuration; a fixed seed gives the same forest for any thread count
+        void setNumThreads(int threads) { numThreads = threads; }
+        void setSeed(uint32_t s) { seed = s; }
+        uint32_t getSeed() const { return seed; }
+        void setShowProgress(bool show) { showProgress = show; }
+        void setTreeLimits(const TreeLimits& l) { limits = l; }
+        const TreeLimits& getTreeLimits() const { return limits; }
+
+        // Train numTrees trees and append them to the forest. Calling it again with a newer data
+        // window adds trees for that window; its dictionaries are merged into the forest's so the
+        // existing trees keep their meaning.
         void train(const vector<DataPoint>& data, const vector<string>& attributes);
+        void train(const EncodedDataset& data, const vector<string>& attributes);
+
+        // Train on a subset of the rows of data (e.g. the training folds of a cross-validation);
+        // the out-of-bag estimate only covers those rows
+        void train(const EncodedDataset& data, const vector<RowIndex>& rows, const vector<string>& attributes);
+
+        // Out-of-bag accuracy and log-loss of the trees added by the last train call, measured on
+        // the data they were trained on
+        const OobEstimate& getOobEstimate() const { return oob; }
+
+        // Append trees built elsewhere (e.g. by StreamingTrainer) whose codes follow trainedSchema,
+        // taking ownership of them, and recompile
+        void addTrees(vector<DecisionTree>&& newTrees, const DatasetSchema& trainedSchema);
+
+        // Remove the count oldest trees (those added first)
+        void retireOldestTrees(size_t count);
+
+        // Re-estimate every leaf's prediction from a fresh data window, keeping the tree structure.
+        // Leaves that no row of the window reaches keep their prediction.
+        void refitLeaves(const EncodedDataset& window);
+
+        // Sliding-window update: trains numTrees trees on the new window, then retires the oldest
+        // trees so that at most maxTrees remain
+        void slideWindow(const EncodedDataset& window, const vector<string>& attributes, size_t maxTrees);
+
+        // Write the compiled forest and its dictionaries to a versioned binary model file
+        bool save(const string& path) const;
+
+        // Memory-map a model file written by save; the trees are used in place without parsing.
+        // Returns false (leaving the forest unchanged) if the file is missing or invalid.
+        bool load(const string& path);
+
+        // Rebuild the flattened inference copy of the trees (done automatically by train)
+        void compile();
+
+        // Precompute the votes for every combination of category codes so that predictions become
+        // a single table read. Returns false (keeping tree evaluation) if the table would exceed
+        // maxEntries. The table is dropped whenever the forest is recompiled.
+        bool buildLookupTable(size_t maxEntries = 1 << 22);
+        bool hasLookupTable() const { return !lookupTable.empty(); }
 
         // Predict the outcome for a data point
         int predict(const DataPoint& point);
 
+        // Predict the outcome for a row encoded with this forest's schema
+        int predict(const EncodedRow& point) const;
+
+        // Click probability: the mean over trees of the click rate of the leaf the point reaches
+        double predictProbability(const DataPoint& point) const;
+        double predictProbability(const EncodedRow& point) const;
+
+        // Predict every row of a batch encoded with this forest's schema. predictions (0/1 majority
+        // votes) and probabilities (as predictProbability) may each be null; trees are evaluated
+        // one at a time over blocks of rows, and large batches are split across threads.
+        void predictBatch(const EncodedBatch& batch, int* predictions, double* probabilities = nullptr) const;
+
+        // Predict every row of a batch for each of several codes of one column (e.g. every ad
+        // position), without re-walking the trees per candidate. Results for row r and values[i]
+        // are written at [r * values.size() + i]; either output may be null.
+        void predictSweep(const EncodedBatch& batch, int column, const vector<CategoryCode>& values,
+            int* predictions, double* probabilities = nullptr) const;
+
+        // Dictionaries used to encode rows for this forest
+        const DatasetSchema& getSchema() const { return schema; }
+
+        // Flattened trees in the order they were added, e.g. to score a prefix of the forest
+        const CompiledForest& getCompiledForest() const { return compiled; }
+
         // Getter for number of trees (debugging purposes)
-        int getNumTrees() const { return trees.size(); }
+        int getNumTrees() const { return static_cast<int>(compiled.numTrees()); }
 
         // Predict using a specific tree (debugging purposes)
         int predictWithTree(const DataPoint& point, int treeIndex) const;
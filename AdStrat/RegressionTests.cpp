@@ -1,7 +1,12 @@
 #include "RegressionTests.h"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <random>
 #include <vector>
 #include "SuggestionMaker.h"  // Make sure to include this if needed
+#include "ForestKernels.h"
 
 using namespace std;
 
@@ -12,6 +17,198 @@ RandomForest trainRandomForest(const vector<DataPoint>& dataPoints, const vector
     return rf;
 }
 
+RandomForest trainRandomForest(const EncodedDataset& data, const vector<string>& attributes, int num) {
+    RandomForest rf(num);
+    rf.train(data, attributes);
+    return rf;
+}
+
+// Function to check training on a tiny dataset
+bool testSmallDatasetTraining(const EncodedDataset& data, const vector<string>& attributes) {
+    EncodedDataset tiny = data.head(10);
+    RandomForest rf(5);
+    rf.setShowProgress(false);
+    rf.train(tiny, attributes);
+
+    vector<int> predictions(tiny.size());
+    vector<double> probabilities(tiny.size());
+    rf.predictBatch(tiny.batch(), predictions.data(), probabilities.data());
+    for (size_t r = 0; r < tiny.size(); ++r) {
+        if ((predictions[r] != 0 && predictions[r] != 1) || probabilities[r] < 0.0 || probabilities[r] > 1.0) {
+            cerr << "Small dataset test failed: invalid prediction for row " << r << endl;
+            return false;
+        }
+    }
+    cout << "Small dataset test passed: trained " << rf.getNumTrees() << " trees on " << tiny.size() << " rows" << endl;
+    return true;
+}
+
+// Function to check the dispatched batch kernel against the scalar one
+bool testKernelAgreement(const RandomForest& rf, const EncodedDataset& data) {
+    const CompiledForest& forest = rf.getCompiledForest();
+    EncodedBatch batch = data.batch();
+    size_t treeCount = forest.numTrees();
+
+    vector<uint32_t> scalarVotes(batch.size, 0), dispatchedVotes(batch.size, 0);
+    vector<float> scalarRates(batch.size, 0.0f), dispatchedRates(batch.size, 0.0f);
+    accumulateVotesScalar(forest, batch, scalarVotes.data(), scalarRates.data());
+    forest.accumulateVotes(batch, dispatchedVotes.data(), dispatchedRates.data());
+
+    vector<int> predictions(batch.size);
+    vector<double> probabilities(batch.size);
+    rf.predictBatch(batch, predictions.data(), probabilities.data());
+
+    for (size_t r = 0; r < batch.size; ++r) {
+        int expected = (scalarVotes[r] > treeCount / 2) ? 1 : 0;
+        double expectedRate = treeCount > 0 ? scalarRates[r] / static_cast<double>(treeCount) : 0.0;
+        if (dispatchedVotes[r] != scalarVotes[r] || predictions[r] != expected || fabs(probabilities[r] - expectedRate) > 1e-6) {
+            cerr << "Kernel agreement test failed: row " << r << " has " << dispatchedVotes[r] << " votes and prediction "
+                << predictions[r] << ", the scalar kernel " << scalarVotes[r] << " and " << expected << endl;
+            return false;
+        }
+    }
+    cout << "Kernel agreement test passed: " << (avx2Available() ? "AVX2" : "scalar") << " kernel matches the scalar one on "
+        << batch.size << " rows" << endl;
+    return true;
+}
+
+// Returns the vote of every leaf of a compiled forest (-1 for split nodes)
+static vector<int> leafVotes(const CompiledForest& forest) {
+    vector<int> votes(forest.numNodes());
+    for (size_t n = 0; n < forest.numNodes(); ++n) {
+        const CompiledNode& node = forest.nodeData()[n];
+        votes[n] = node.feature < 0 ? node.prediction : -1;
+    }
+    return votes;
+}
+
+// Function to check sliding-window updates and leaf refits
+bool testSlidingWindow(const EncodedDataset& data, const vector<string>& attributes) {
+    const int treesPerWindow = 4;
+    const size_t maxTrees = 6;
+    size_t half = data.size() / 2;
+    EncodedDataset older = data.head(half), newer;
+    for (size_t r = half; r < data.size(); ++r) newer.addRow(data.decodeRow(r));
+
+    RandomForest rf(treesPerWindow);
+    rf.setSeed(7);
+    rf.setShowProgress(false);
+    rf.train(older, attributes);
+    rf.slideWindow(newer, attributes, maxTrees);
+    rf.slideWindow(older, attributes, maxTrees);
+    if (static_cast<size_t>(rf.getNumTrees()) != maxTrees) {
+        cerr << "Sliding window test failed: " << rf.getNumTrees() << " trees kept, expected " << maxTrees << endl;
+        return false;
+    }
+
+    vector<CategoryCode> storage[NUM_CATEGORICAL];
+    EncodedBatch batch = newer.recodedBatch(rf.getSchema(), storage);
+    vector<int> predictions(batch.size);
+    vector<double> probabilities(batch.size);
+    rf.predictBatch(batch, predictions.data(), probabilities.data());
+    for (size_t r = 0; r < batch.size; ++r) {
+        if ((predictions[r] != 0 && predictions[r] != 1) || probabilities[r] < 0.0 || probabilities[r] > 1.0) {
+            cerr << "Sliding window test failed: invalid prediction for row " << r << endl;
+            return false;
+        }
+    }
+
+    // The trees were grown on bootstrap samples, so the first refit may move some leaves; once
+    // fitted to the window, fitting to it again must leave every vote as it is
+    rf.refitLeaves(older);
+    vector<int> fitted = leafVotes(rf.getCompiledForest());
+    rf.refitLeaves(older);
+    if (leafVotes(rf.getCompiledForest()) != fitted) {
+        cerr << "Sliding window test failed: refitting the same window changed leaf votes" << endl;
+        return false;
+    }
+    cout << "Sliding window test passed: " << rf.getNumTrees() << " trees kept, leaf refit is stable" << endl;
+    return true;
+}
+
+// Function to check a parallel load matches a serial one
+bool testParallelLoad() {
+    const int threads = 4;
+    const size_t rows = 320000;  // About 20 MB: enough for every thread to get a chunk
+    string path = (filesystem::temp_directory_path() / "adstrat_parallel_load.csv.tmp").string();
+    {
+        // Later rows draw from more values, so chunks first see values in a different order
+        // than the whole file does and the dictionary merge has to reconcile them
+        mt19937 rng(11);
+        ofstream file(path, ios::binary);
+        file << "id,full_name,age,gender,device_type,ad_position,browsing_history,time_of_day,click\n";
+        for (size_t i = 0; i < rows; ++i) {
+            size_t spread = 2 + i * 200 / rows;
+            file << i << ",User" << i << ",";
+            if (rng() % 10) file << 18 + rng() % 50;
+            for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+                file << ",";
+                if (rng() % 10) file << columnName(c) << rng() % spread;
+            }
+            file << "," << rng() % 2 << (i % 3 ? "\n" : "\r\n");
+        }
+    }
+
+    ImportedData loader(path);
+    EncodedDataset serial, parallel;
+    bool loaded = loader.loadEncoded(serial, 1) && loader.loadEncoded(parallel, threads);
+    filesystem::remove(path);
+    if (!loaded || serial.size() != rows || parallel.size() != rows) {
+        cerr << "Parallel load test failed: the scratch file did not load completely" << endl;
+        return false;
+    }
+
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        const CategoryDictionary& expected = serial.getSchema().dictionary(c);
+        const CategoryDictionary& actual = parallel.getSchema().dictionary(c);
+        bool same = expected.size() == actual.size() && equal(serial.column(c), serial.column(c) + rows, parallel.column(c));
+        for (size_t code = 0; same && code < expected.size(); ++code) {
+            same = expected.decode(static_cast<CategoryCode>(code)) == actual.decode(static_cast<CategoryCode>(code));
+        }
+        if (!same) {
+            cerr << "Parallel load test failed: column " << columnName(c) << " differs from the serial load" << endl;
+            return false;
+        }
+    }
+    if (!equal(serial.ageColumn(), serial.ageColumn() + rows, parallel.ageColumn()) ||
+        !equal(serial.clickColumn(), serial.clickColumn() + rows, parallel.clickColumn())) {
+        cerr << "Parallel load test failed: ages or clicks differ from the serial load" << endl;
+        return false;
+    }
+    cout << "Parallel load test passed: " << threads << " threads match a serial load of " << rows << " rows" << endl;
+    return true;
+}
+
+// Writes a CSV with the given number of distinct gender values and tries to load it
+static bool loadDistinctGenders(const string& path, size_t distinct) {
+    {
+        ofstream file(path, ios::binary);
+        file << "id,full_name,age,gender,device_type,ad_position,browsing_history,time_of_day,click\n";
+        for (size_t i = 0; i < distinct; ++i) {
+            file << i << ",User," << 20 + i % 40 << ",G" << i << ",Mobile,Top,News,Morning," << i % 2 << "\n";
+        }
+    }
+    ImportedData loader(path);
+    EncodedDataset data;
+    return loader.loadEncoded(data);
+}
+
+// Function to check a full dictionary fails the load
+bool testDictionaryLimit() {
+    string path = (filesystem::temp_directory_path() / "adstrat_dictionary_limit.csv.tmp").string();
+    bool fits = loadDistinctGenders(path, MAX_CATEGORY_VALUES);
+    cout << "(The next load is expected to report a full column)" << endl;
+    bool overflows = loadDistinctGenders(path, MAX_CATEGORY_VALUES + 1);
+    filesystem::remove(path);
+
+    if (!fits || overflows) {
+        cerr << "Dictionary limit test failed: " << (fits ? "a column with too many values was loaded" : "a full column was rejected") << endl;
+        return false;
+    }
+    cout << "Dictionary limit test passed: " << MAX_CATEGORY_VALUES << " values load, one more fails" << endl;
+    return true;
+}
+
 // Function to run all regression tests
 void runRegressionTests(RandomForest& rf, const vector<DataPoint>& testCases, const vector<int>& expectedPredictions, const vector<string>& expectedSuggestions) {
     int failedTests = 0;
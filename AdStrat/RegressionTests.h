@@ -5,9 +5,34 @@
 #include <string>
 #include "RandomForest.h"
 #include "ImportedData.h"
+#include "EncodedDataset.h"
 
 // Function to train the RandomForest model
 RandomForest trainRandomForest(const std::vector<DataPoint>& dataPoints, const std::vector<std::string>& attributes, int num);
+RandomForest trainRandomForest(const EncodedDataset& data, const std::vector<std::string>& attributes, int num);
+
+// Trains a small forest on the first rows of data (fewer rows than quantile bins, trees or
+// folds usually assume) and checks it makes valid predictions; returns false on failure
+bool testSmallDatasetTraining(const EncodedDataset& data, const std::vector<std::string>& attributes);
+
+// Scores data with the forced scalar kernel and with predictBatch (which uses the AVX2 kernel
+// where available) and checks every vote, prediction and probability agrees; rf must have been
+// trained on data and not yet have a lookup table. Returns false on failure.
+bool testKernelAgreement(const RandomForest& rf, const EncodedDataset& data);
+
+// Slides a forest over two halves of data past its tree cap and checks the cap holds, the
+// predictions stay valid, and refitting the leaves twice on one window changes nothing the
+// second time; returns false on failure
+bool testSlidingWindow(const EncodedDataset& data, const std::vector<std::string>& attributes);
+
+// Writes a scratch CSV large enough to be split into chunks, loads it on one thread and on
+// several, and checks both give the same dictionaries, codes, ages and clicks; returns false
+// on failure
+bool testParallelLoad();
+
+// Loads a scratch CSV whose gender column fills its dictionary exactly, then one with a
+// value more, which must fail instead of reusing MISSING_CODE; returns false on failure
+bool testDictionaryLimit();
 
 // Function to run all regression tests
 void runRegressionTests(RandomForest& rf, const std::vector<DataPoint>& testCases, const std::vector<int>& expectedPredictions, const std::vector<std::string>& expectedSuggestions);
@@ -0,0 +1,430 @@
+#include "ScoringServer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Socket handles are kept as intptr_t; both platforms' invalid handle converts to -1
+#ifdef _WIN32
+typedef SOCKET NativeSocket;
+static const int SHUTDOWN_BOTH = SD_BOTH;
+static void closeSocket(intptr_t s) { closesocket(static_cast<NativeSocket>(s)); }
+#else
+typedef int NativeSocket;
+static const int SHUTDOWN_BOTH = SHUT_RDWR;
+static void closeSocket(intptr_t s) { ::close(static_cast<NativeSocket>(s)); }
+#endif
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;  // A closed peer must not raise SIGPIPE
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+static bool sendAll(intptr_t s, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int chunk = static_cast<int>(min<size_t>(data.size() - sent, 1 << 20));
+        auto n = send(static_cast<NativeSocket>(s), data.data() + sent, chunk, SEND_FLAGS);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static const size_t MAX_LINE_BYTES = 64 << 10;   // Longer lines close the connection
+static const size_t LATENCY_SAMPLES = 1 << 16;   // Recent requests kept for the percentiles
+
+ScoringServer::ScoringServer(const RandomForest& forest, const vector<string>& candidatePlacements)
+    : rf(forest), placements(candidatePlacements) {
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+    for (const auto& placement : placements) {
+        placementCodes.push_back(rf.getSchema().dictionary(COL_AD_POSITION).lookup(placement));
+    }
+    latencies.reserve(LATENCY_SAMPLES);
+}
+
+ScoringServer::~ScoringServer() {
+    stop();
+#ifndef _WIN32
+    if (unixSocket) unlink(socketPath.c_str());
+#endif
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+bool ScoringServer::bindListener(int family, const void* address, size_t addressBytes) {
+    NativeSocket s = socket(family, SOCK_STREAM, 0);
+    if (static_cast<intptr_t>(s) == -1) {
+        cerr << "Failed to create the server socket" << endl;
+        return false;
+    }
+    if (family == AF_INET) {
+        int one = 1;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+    }
+    if (::bind(s, static_cast<const sockaddr*>(address), static_cast<int>(addressBytes)) != 0 || listen(s, SOMAXCONN) != 0) {
+        cerr << "Failed to bind the server socket" << endl;
+        closeSocket(static_cast<intptr_t>(s));
+        return false;
+    }
+    listener = static_cast<intptr_t>(s);
+    return true;
+}
+
+bool ScoringServer::listenUnix(const string& path) {
+#ifdef _WIN32
+    cerr << "Unix domain sockets are not supported on this platform; use a TCP port" << endl;
+    return false;
+#else
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        cerr << "Socket path is too long: " << path << endl;
+        return false;
+    }
+    path.copy(address.sun_path, path.size());
+
+    unlink(path.c_str());  // A socket file left by a previous run would make bind fail
+    if (!bindListener(AF_UNIX, &address, sizeof(address))) return false;
+    unixSocket = true;
+    socketPath = path;
+    return true;
+#endif
+}
+
+bool ScoringServer::listenTcp(int port) {
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // Only local clients
+    return bindListener(AF_INET, &address, sizeof(address));
+}
+
+void ScoringServer::run() {
+    if (listener == -1) return;
+    thread batcher(&ScoringServer::batchLoop, this);
+
+    while (!stopping) {
+        NativeSocket client = accept(static_cast<NativeSocket>(listener), nullptr, nullptr);
+        if (static_cast<intptr_t>(client) == -1) continue;  // stop() closes the listener
+        if (!unixSocket) {
+            int one = 1;  // Replies are single small lines; do not hold them back
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+        }
+
+        lock_guard<mutex> lock(clientMutex);
+        if (stopping) {
+            closeSocket(static_cast<intptr_t>(client));
+            break;
+        }
+        clients.push_back(static_cast<intptr_t>(client));
+        activeClients++;
+        thread(&ScoringServer::serveClient, this, static_cast<intptr_t>(client)).detach();
+    }
+
+    // Clients get their queued requests answered before the batcher is told to exit
+    {
+        unique_lock<mutex> lock(clientMutex);
+        clientsFinished.wait(lock, [&] { return activeClients == 0; });
+    }
+    {
+        lock_guard<mutex> lock(queueMutex);
+        batcherExit = true;
+    }
+    queueReady.notify_all();
+    batcher.join();
+}
+
+void ScoringServer::stop() {
+    if (stopping.exchange(true)) return;
+
+    lock_guard<mutex> lock(clientMutex);
+    if (listener != -1) {
+        shutdown(static_cast<NativeSocket>(listener), SHUTDOWN_BOTH);  // Wakes a blocked accept
+        closeSocket(listener);
+        listener = -1;
+    }
+    for (intptr_t client : clients) {
+        shutdown(static_cast<NativeSocket>(client), SHUTDOWN_BOTH);
+    }
+}
+
+void ScoringServer::serveClient(intptr_t client) {
+    string pending;  // Received bytes after the last complete line
+    char buffer[4096];
+
+    while (true) {
+        auto received = recv(static_cast<NativeSocket>(client), buffer, sizeof(buffer), 0);
+        if (received <= 0) break;
+        pending.append(buffer, static_cast<size_t>(received));
+
+        // Queue every complete line before waiting, so pipelined requests share a batch
+        deque<Request> requests;
+        vector<string> replies;
+        size_t start = 0, end;
+        while ((end = pending.find('\n', start)) != string::npos) {
+            string line = pending.substr(start, end - start);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            start = end + 1;
+
+            requests.emplace_back();
+            replies.push_back(handleLine(line, requests.back()));
+        }
+        pending.erase(0, start);
+        if (pending.size() > MAX_LINE_BYTES) break;
+        if (requests.empty()) continue;
+
+        {
+            unique_lock<mutex> lock(doneMutex);
+            batchDone.wait(lock, [&] {
+                for (size_t i = 0; i < requests.size(); ++i) {
+                    if (replies[i].empty() && !requests[i].done) return false;
+                }
+                return true;
+            });
+        }
+
+        string out;
+        for (size_t i = 0; i < requests.size(); ++i) {
+            out += replies[i].empty() ? formatResult(requests[i]) : replies[i];
+            out += '\n';
+        }
+        if (!sendAll(client, out)) break;
+    }
+
+    lock_guard<mutex> lock(clientMutex);
+    clients.erase(find(clients.begin(), clients.end(), client));
+    closeSocket(client);
+    activeClients--;
+    clientsFinished.notify_all();
+}
+
+string ScoringServer::handleLine(const string& line, Request& request) {
+    size_t space = line.find(' ');
+    string command = line.substr(0, space);
+
+    if (command == "stats") {
+        LatencySummary summary = latency();
+        char reply[128];
+        snprintf(reply, sizeof(reply), "ok requests=%zu p50_us=%.1f p99_us=%.1f", summary.requests, summary.p50Micros, summary.p99Micros);
+        return reply;
+    }
+    if (command != "predict" && command != "suggest") return "error unknown command";
+
+    // Fields in DataPoint order, separated by commas; empty fields are scored as missing
+    vector<string> fields;
+    size_t start = space == string::npos ? line.size() : space + 1;
+    while (true) {
+        size_t comma = line.find(',', start);
+        fields.push_back(line.substr(start, comma - start));
+        if (comma == string::npos) break;
+        start = comma + 1;
+    }
+    if (fields.size() != 6) return "error expected 6 fields: age,gender,deviceType,adPosition,browsingHistory,timeOfDay";
+
+    DataPoint point;
+    point.age = MISSING_AGE;
+    if (!fields[0].empty()) {
+        char* parsedEnd;
+        double age = strtod(fields[0].c_str(), &parsedEnd);
+        if (*parsedEnd != '\0') return "error invalid age";
+        point.age = static_cast<int>(age);
+    }
+    point.gender = fields[1];
+    point.deviceType = fields[2];
+    point.adPosition = fields[3];
+    point.browsingHistory = fields[4];
+    point.timeOfDay = fields[5];
+    point.click = -1;
+
+    // The trees only saw imputed rows, so missing values are imputed the same way
+    bool missing = point.age == MISSING_AGE;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        missing = missing || columnValue(point, c).empty();
+    }
+    if (missing) {
+        if (!hasStats) return "error empty fields need imputation statistics, which the model does not have";
+        vector<DataPoint> points(1, point);
+        DataImputer().apply(points, stats);
+        point = points[0];
+    }
+
+    request.suggest = command == "suggest";
+    request.row = rf.getSchema().encodeRow(point);
+    request.received = chrono::steady_clock::now();
+    {
+        lock_guard<mutex> lock(queueMutex);
+        queue.push_back(&request);
+    }
+    queueReady.notify_one();
+    return string();
+}
+
+string ScoringServer::formatResult(const Request& request) const {
+    char reply[128];
+    if (!request.suggest) {
+        snprintf(reply, sizeof(reply), "ok %d %.6f", request.prediction, request.probability);
+    }
+    else {
+        const char* placement = request.bestPlacement >= 0 ? placements[request.bestPlacement].c_str() : "None";
+        snprintf(reply, sizeof(reply), "ok %s %.6f %.6f", placement, request.bestProbability, request.probability);
+    }
+    return reply;
+}
+
+void ScoringServer::batchLoop() {
+    vector<Request*> batch;
+    auto lastReport = chrono::steady_clock::now();
+    size_t lastReportCount = 0;
+
+    while (true) {
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueReady.wait(lock, [&] { return batcherExit || !queue.empty(); });
+            if (queue.empty()) break;
+
+            // Give requests arriving on other connections a moment to join this batch
+            if (queue.size() < maxBatch && maxDelay.count() > 0) {
+                queueReady.wait_for(lock, maxDelay, [&] { return batcherExit || queue.size() >= maxBatch; });
+            }
+            size_t take = min(maxBatch, queue.size());
+            batch.assign(queue.begin(), queue.begin() + take);
+            queue.erase(queue.begin(), queue.begin() + take);
+        }
+
+        scoreBatch(batch);
+
+        auto now = chrono::steady_clock::now();
+        {
+            lock_guard<mutex> lock(doneMutex);
+            for (Request* request : batch) {
+                float micros = chrono::duration<float, micro>(now - request->received).count();
+                if (latencies.size() < LATENCY_SAMPLES) latencies.push_back(micros);
+                else latencies[latencyCount % LATENCY_SAMPLES] = micros;
+                latencyCount++;
+                request->done = true;
+            }
+        }
+        batchDone.notify_all();
+
+        if (reportInterval.count() > 0 && now - lastReport >= reportInterval) {
+            LatencySummary summary = latency();
+            if (summary.requests > lastReportCount) {
+                cout << "Served " << summary.requests << " requests | p50 " << summary.p50Micros
+                    << " us | p99 " << summary.p99Micros << " us" << endl;
+                lastReportCount = summary.requests;
+            }
+            lastReport = now;
+        }
+    }
+}
+
+void ScoringServer::scoreBatch(const vector<Request*>& batch) {
+    size_t n = batch.size();
+
+    // Column copies of the batch; suggest rows are also gathered for the placement sweep
+    vector<CategoryCode> columns[NUM_CATEGORICAL], suggestColumns[NUM_CATEGORICAL];
+    vector<int> ages(n), suggestAges;
+    vector<size_t> suggestRows;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        columns[c].resize(n);
+    }
+    for (size_t r = 0; r < n; ++r) {
+        const EncodedRow& row = batch[r]->row;
+        ages[r] = row.age;
+        for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+            columns[c][r] = row.codes[c];
+        }
+        if (batch[r]->suggest) {
+            suggestRows.push_back(r);
+            suggestAges.push_back(row.age);
+            for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+                suggestColumns[c].push_back(row.codes[c]);
+            }
+        }
+    }
+
+    EncodedBatch all;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        all.columns[c] = columns[c].data();
+    }
+    all.ages = ages.data();
+    all.size = n;
+
+    vector<int> predictions(n);
+    vector<double> probabilities(n);
+    rf.predictBatch(all, predictions.data(), probabilities.data());
+    for (size_t r = 0; r < n; ++r) {
+        batch[r]->prediction = predictions[r];
+        batch[r]->probability = probabilities[r];
+    }
+    if (suggestRows.empty() || placementCodes.empty()) return;
+
+    // The best other placement is suggested only if it is predicted to get a click and its
+    // click probability beats the current placement's
+    EncodedBatch suggest;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        suggest.columns[c] = suggestColumns[c].data();
+    }
+    suggest.ages = suggestAges.data();
+    suggest.size = suggestRows.size();
+
+    size_t k = placementCodes.size();
+    vector<int> sweepPredictions(suggest.size * k);
+    vector<double> sweepProbabilities(suggest.size * k);
+    rf.predictSweep(suggest, COL_AD_POSITION, placementCodes, sweepPredictions.data(), sweepProbabilities.data());
+
+    for (size_t s = 0; s < suggestRows.size(); ++s) {
+        Request& request = *batch[suggestRows[s]];
+        int best = -1;
+        for (size_t i = 0; i < k; ++i) {
+            if (placementCodes[i] == request.row.codes[COL_AD_POSITION]) continue;
+            if (best < 0 || sweepProbabilities[s * k + i] > sweepProbabilities[s * k + best]) best = static_cast<int>(i);
+        }
+        if (best < 0) continue;
+        request.bestProbability = sweepProbabilities[s * k + best];
+        bool better = sweepPredictions[s * k + best] == 1 && request.bestProbability > request.probability;
+        request.bestPlacement = better ? best : -1;
+    }
+}
+
+LatencySummary ScoringServer::latency() {
+    vector<float> samples;
+    LatencySummary summary;
+    {
+        lock_guard<mutex> lock(doneMutex);
+        samples = latencies;
+        summary.requests = latencyCount;
+    }
+    if (samples.empty()) return summary;
+
+    auto percentile = [&](double q) {
+        size_t i = static_cast<size_t>(q * (samples.size() - 1) + 0.5);
+        nth_element(samples.begin(), samples.begin() + i, samples.end());
+        return static_cast<double>(samples[i]);
+    };
+    summary.p50Micros = percentile(0.50);
+    summary.p99Micros = percentile(0.99);
+    return summary;
+}
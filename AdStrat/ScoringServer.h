@@ -0,0 +1,125 @@
+#ifndef SCORING_SERVER_H
+#define SCORING_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "RandomForest.h"
+#include "DataImputer.h"
+
+using namespace std;
+
+// Server-side latency of the requests answered so far (from the time a request line is read
+// to the time its result is ready)
+struct LatencySummary {
+    size_t requests = 0;
+    double p50Micros = 0.0;
+    double p99Micros = 0.0;
+};
+
+// Long-running scoring service for a trained forest. Clients connect over a Unix domain socket
+// (POSIX only) or TCP on localhost and send one request per line:
+//   predict <age>,<gender>,<deviceType>,<adPosition>,<browsingHistory>,<timeOfDay>
+//   suggest <same fields>
+//   stats
+// Each request gets one line back, in order:
+//   ok <prediction> <clickProbability>
+//   ok <suggestedPlacement or None> <itsClickProbability> <currentClickProbability>
+//   ok requests=<n> p50_us=<p50> p99_us=<p99>
+//   error <message>
+// Empty fields are filled from the training data's imputation statistics, as training rows
+// were; without statistics such requests are rejected.
+// suggest names the other placement with the highest click probability, or None unless that
+// placement is predicted to get a click and beats the current placement's probability.
+// Requests from all connections go to one queue. A batcher thread scores them in micro-batches
+// with predictBatch and predictSweep: once a request is queued it waits up to maxDelay for
+// others to join, and takes at most maxBatch at a time.
+class ScoringServer {
+    // A queued predict or suggest request; results are filled in by the batcher
+    struct Request {
+        bool suggest = false;
+        EncodedRow row;
+        chrono::steady_clock::time_point received;
+        int prediction = 0;
+        double probability = 0.0;       // Click probability of the row as given
+        int bestPlacement = -1;         // suggest: index into placements, -1 if none is better
+        double bestProbability = 0.0;
+        bool done = false;
+    };
+
+    const RandomForest& rf;
+    vector<string> placements;
+    vector<CategoryCode> placementCodes;
+    size_t maxBatch = 256;
+    chrono::microseconds maxDelay{ 50 };
+    chrono::seconds reportInterval{ 10 };  // Latency is printed to cout this often (0 = never)
+    ImputationStats stats;                 // Used to fill empty request fields when hasStats is set
+    bool hasStats = false;
+
+    intptr_t listener = -1;
+    bool unixSocket = false;
+    string socketPath;
+    atomic<bool> stopping{ false };
+
+    mutex queueMutex;
+    condition_variable queueReady;
+    deque<Request*> queue;
+    bool batcherExit = false;  // Set by run once no client can queue more requests
+
+    mutex doneMutex;
+    condition_variable batchDone;
+    vector<float> latencies;  // Microseconds; the most recent samples are kept
+    size_t latencyCount = 0;  // Requests answered, including samples no longer kept
+
+    mutex clientMutex;
+    condition_variable clientsFinished;
+    vector<intptr_t> clients;  // Open connections, each served by a detached thread
+    size_t activeClients = 0;
+
+    bool bindListener(int family, const void* address, size_t addressBytes);
+    void batchLoop();
+    void serveClient(intptr_t client);
+    void scoreBatch(const vector<Request*>& batch);
+
+    // Parses one request line. Predict and suggest requests are queued for the batcher and
+    // return an empty string; anything else is answered at once.
+    string handleLine(const string& line, Request& request);
+
+    // Reply line of a scored request
+    string formatResult(const Request& request) const;
+
+public:
+    // placements are the ad positions suggest chooses from
+    ScoringServer(const RandomForest& forest, const vector<string>& placements);
+    ~ScoringServer();
+
+    ScoringServer(const ScoringServer&) = delete;
+    ScoringServer& operator=(const ScoringServer&) = delete;
+
+    void setMaxBatch(size_t rows) { maxBatch = rows > 0 ? rows : 1; }
+    void setMaxDelay(chrono::microseconds delay) { maxDelay = delay; }
+    void setReportInterval(chrono::seconds interval) { reportInterval = interval; }
+
+    // Impute empty request fields from these statistics (normally the training data's)
+    void setImputationStats(const ImputationStats& trainingStats) { stats = trainingStats; hasStats = true; }
+
+    // Listen on a Unix domain socket at path (replacing a stale socket file) or on 127.0.0.1:port.
+    // Return false, with a message on cerr, if the socket cannot be created.
+    bool listenUnix(const string& path);
+    bool listenTcp(int port);
+
+    // Accepts and serves clients until stop is called
+    void run();
+
+    // Closes the listener and every connection; run returns once the queue is drained
+    void stop();
+
+    LatencySummary latency();
+};
+
+#endif // SCORING_SERVER_H
@@ -0,0 +1,234 @@
+#include "StreamingTrainer.h"
+#include "ThreadPool.h"
+#include <cmath>
+#include <iostream>
+
+// Node of a tree while it is grown level by level
+struct GrowNode {
+    int splitAttribute = -1;
+    CategoryCode splitValue = MISSING_CODE;
+    int left = -1;
+    int right = -1;
+    int prediction = -1;  // Set once the node is closed as a leaf
+    float clickRate = 0;  // Weighted click rate, set with prediction
+    int openSlot = -1;    // Index of the node's statistics while it is open
+};
+
+// Tree being grown, with the click counts of its open nodes for the current pass
+struct GrowTree {
+    vector<int> columns;  // Attribute subset chosen for this tree
+    size_t statsWidth = 0;  // Buckets of all columns, i.e. counts kept per open node
+    vector<GrowNode> nodes;
+    vector<int> openNodes;
+    vector<int64_t> totals, clicks;   // Per open node; 64-bit, as weights are summed over the whole file
+    vector<int64_t> rowCounts, clickCounts;  // Per open node, per column, per bucket
+};
+
+// Mixes the bits of x (SplitMix64 finalizer)
+static uint64_t mixBits(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Poisson(1) draw for a (tree, row) pair; the same on every pass over the data
+static uint32_t bootstrapWeight(uint32_t seed, size_t tree, uint64_t row) {
+    uint64_t hash = mixBits(mixBits((static_cast<uint64_t>(seed) << 32) | tree) ^ row);
+    double u = (hash >> 11) / 9007199254740992.0;  // Uniform in [0, 1) from the top 53 bits
+
+    double p = exp(-1.0), cdf = p;
+    uint32_t k = 0;
+    while (u >= cdf && k < 16) {
+        ++k;
+        p /= k;
+        cdf += p;
+    }
+    return k;
+}
+
+// Converts a grown tree into TreeNodes
+static TreeNode* toTreeNode(const vector<GrowNode>& nodes, int index, TreeArena& arena) {
+    const GrowNode& source = nodes[index];
+    TreeNode* node = arena.allocate();
+    if (source.splitAttribute < 0) {
+        node->prediction = source.prediction;
+        node->clickRate = source.clickRate;
+        return node;
+    }
+    node->splitAttribute = source.splitAttribute;
+    node->splitValue = source.splitValue;
+    node->left = toTreeNode(nodes, source.left, arena);
+    node->right = toTreeNode(nodes, source.right, arena);
+    return node;
+}
+
+StreamingTrainer::StreamingTrainer(const string& file) : fileName(file), seed(random_device{}()) {}
+
+bool StreamingTrainer::train(RandomForest& rf, int numTrees, const vector<string>& attributes) {
+    ImportedData reader(fileName);
+
+    // Pass 0: build the dictionaries and the statistics used to impute missing values
+    DatasetSchema schema;
+    stats = ImputationStats();
+    uint64_t totalRows = 0;
+    bool readOk = reader.streamEncoded(chunkBytes, schema, [&](const EncodedDataset& chunk) {
+        stats.update(chunk, numThreads);
+        totalRows += chunk.size();
+    });
+    if (!readOk) return false;
+
+    // Missing values are replaced by the column mode as rows are read, like DataImputer
+    CategoryCode modes[NUM_CATEGORICAL];
+    size_t buckets[NUM_CATEGORICAL];
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        modes[c] = schema.dictionary(c).lookup(stats.mode(c));
+        buckets[c] = schema.dictionary(c).size() + 1;  // Last bucket holds MISSING_CODE
+    }
+
+    vector<int> columns;
+    for (const auto& attr : attributes) {
+        int column = columnIndex(attr);
+        if (column >= 0) columns.push_back(column);
+    }
+
+    vector<GrowTree> trees(numTrees);
+    for (int t = 0; t < numTrees; ++t) {
+        seed_seq treeSeed{ seed, static_cast<uint32_t>(t) };
+        mt19937 rng(treeSeed);
+        trees[t].columns = columns;
+        shuffle(trees[t].columns.begin(), trees[t].columns.end(), rng);
+        trees[t].columns.resize(min<size_t>(3, trees[t].columns.size())); // Choose a subset of attributes
+        for (int c : trees[t].columns) trees[t].statsWidth += buckets[c];
+
+        trees[t].nodes.push_back(GrowNode());
+        trees[t].nodes[0].openSlot = 0;
+        trees[t].openNodes.push_back(0);
+    }
+
+    ThreadPool pool(numThreads);
+    for (int depth = 0; ; ++depth) {
+        size_t openCount = 0;
+        for (auto& tree : trees) {
+            openCount += tree.openNodes.size();
+            tree.totals.assign(tree.openNodes.size(), 0);
+            tree.clicks.assign(tree.openNodes.size(), 0);
+            tree.rowCounts.assign(tree.openNodes.size() * tree.statsWidth, 0);
+            tree.clickCounts.assign(tree.openNodes.size() * tree.statsWidth, 0);
+        }
+        if (openCount == 0) break;
+
+        cout << "Streaming training: level " << depth << ", " << openCount << " open nodes\r";
+        cout.flush();
+
+        // One pass over the file accumulates the statistics of every open node of every tree
+        uint64_t rowOffset = 0;
+        bool newValues = false;
+        readOk = reader.streamEncoded(chunkBytes, schema, [&](const EncodedDataset& chunk) {
+            // Values pass 0 did not see have no bucket; the file changed under us
+            for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+                newValues = newValues || chunk.getSchema().dictionary(c).size() + 1 != buckets[c];
+            }
+            if (newValues) return;
+
+            const int* chunkClicks = chunk.clickColumn();
+            pool.parallelFor(trees.size(), [&](size_t t) {
+                GrowTree& tree = trees[t];
+                for (size_t r = 0; r < chunk.size(); ++r) {
+                    uint32_t weight = bootstrapWeight(seed, t, rowOffset + r);
+                    if (weight == 0) continue;
+
+                    auto codeAt = [&](int c) {
+                        CategoryCode code = chunk.column(c)[r];
+                        return code == MISSING_CODE ? modes[c] : code;
+                    };
+
+                    // Route the row to its current node
+                    int n = 0;
+                    while (tree.nodes[n].splitAttribute >= 0) {
+                        const GrowNode& node = tree.nodes[n];
+                        n = codeAt(node.splitAttribute) == node.splitValue ? node.left : node.right;
+                    }
+                    int slot = tree.nodes[n].openSlot;
+                    if (slot < 0) continue;  // Reached a finished leaf
+
+                    int isClick = chunkClicks[r] == 1 ? 1 : 0;
+                    tree.totals[slot] += weight;
+                    tree.clicks[slot] += isClick * weight;
+
+                    size_t offset = slot * tree.statsWidth;
+                    for (int c : tree.columns) {
+                        CategoryCode code = codeAt(c);
+                        size_t bucket = code == MISSING_CODE ? buckets[c] - 1 : code;
+                        tree.rowCounts[offset + bucket] += weight;
+                        tree.clickCounts[offset + bucket] += isClick * weight;
+                        offset += buckets[c];
+                    }
+                }
+            });
+            rowOffset += chunk.size();
+        });
+
+        // A failed read or a file that changed since pass 0 would leave the statistics incomplete
+        if (!readOk || newValues || rowOffset != totalRows) {
+            cout << endl;
+            cerr << "Streaming training aborted: " << fileName << (readOk ? " changed" : " could not be read")
+                << " during level " << depth << endl;
+            return false;
+        }
+
+        // Close or split every open node of this level, using the same rules as buildDecisionTree
+        for (auto& tree : trees) {
+            vector<int> nextOpen;
+            for (size_t slot = 0; slot < tree.openNodes.size(); ++slot) {
+                int n = tree.openNodes[slot];
+                int64_t total = tree.totals[slot], countClick = tree.clicks[slot];
+                tree.nodes[n].openSlot = -1;
+                tree.nodes[n].clickRate = total > 0 ? static_cast<float>(countClick) / total : 0.0f;
+
+                if (countClick == 0 || countClick == total) {
+                    tree.nodes[n].prediction = countClick > 0 ? 1 : 0;
+                    continue;
+                }
+
+                SplitCandidate best;
+                bool canGrow = (limits.maxDepth <= 0 || depth < limits.maxDepth) &&
+                    (limits.maxNodes <= 0 || static_cast<int>(tree.nodes.size()) + 2 <= limits.maxNodes);
+                if (canGrow) {
+                    size_t offset = slot * tree.statsWidth;
+                    for (int c : tree.columns) {
+                        vector<int64_t> rowCounts(tree.rowCounts.begin() + offset, tree.rowCounts.begin() + offset + buckets[c]);
+                        vector<int64_t> clickCounts(tree.clickCounts.begin() + offset, tree.clickCounts.begin() + offset + buckets[c]);
+                        scoreSplitCandidates(c, rowCounts, clickCounts, total, countClick, best, limits.minSamplesLeaf);
+                        offset += buckets[c];
+                    }
+                }
+
+                if (!best.separates || giniFromCounts(total, countClick) - best.gini < limits.minImpurityDecrease) {
+                    tree.nodes[n].prediction = (countClick >= total / 2) ? 1 : 0; // Majority class leaf
+                    continue;
+                }
+
+                int left = static_cast<int>(tree.nodes.size());
+                tree.nodes.resize(tree.nodes.size() + 2);
+                tree.nodes[n].splitAttribute = best.attribute;
+                tree.nodes[n].splitValue = best.value;
+                tree.nodes[n].left = left;
+                tree.nodes[n].right = left + 1;
+                for (int child : { left, left + 1 }) {
+                    tree.nodes[child].openSlot = static_cast<int>(nextOpen.size());
+                    nextOpen.push_back(child);
+                }
+            }
+            tree.openNodes.swap(nextOpen);
+        }
+    }
+    cout << endl;
+
+    vector<DecisionTree> built(trees.size());
+    for (size_t t = 0; t < trees.size(); ++t) {
+        built[t].root = toTreeNode(trees[t].nodes, 0, built[t].arena);
+    }
+    rf.addTrees(move(built), schema);
+    return true;
+}
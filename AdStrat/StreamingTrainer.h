@@ -0,0 +1,45 @@
+#ifndef STREAMING_TRAINER_H
+#define STREAMING_TRAINER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "RandomForest.h"
+#include "ImportedData.h"
+#include "DataImputer.h"
+
+using namespace std;
+
+// Trains a random forest from a CSV file without loading it into memory. The file is read
+// in bounded chunks once per tree level: each pass routes every row down the partially
+// grown trees and accumulates per-category click counts for the open nodes, after which
+// all nodes of that level are split (or closed) together.
+//
+// Bootstrap sampling uses online bagging: each (tree, row) pair draws a Poisson(1) weight
+// from a hash of the seed, tree and row number, so every pass sees the same sample.
+class StreamingTrainer {
+    string fileName;
+    size_t chunkBytes = 64 << 20;  // Bytes of CSV held in memory at a time
+    TreeLimits limits;             // Default: grow until nodes are pure or cannot be split
+    int numThreads = 0;            // Trees are updated in parallel for each chunk
+    uint32_t seed;
+    ImputationStats stats;         // Of the file last trained on
+
+public:
+    explicit StreamingTrainer(const string& file);
+
+    void setChunkBytes(size_t bytes) { chunkBytes = bytes; }
+    void setMaxDepth(int depth) { limits.maxDepth = depth; }
+    void setTreeLimits(const TreeLimits& l) { limits = l; }
+    void setNumThreads(int threads) { numThreads = threads; }
+    void setSeed(uint32_t s) { seed = s; }
+
+    // Grows numTrees trees and adds them to rf; returns false if the file cannot be read or
+    // changes between passes
+    bool train(RandomForest& rf, int numTrees, const vector<string>& attributes);
+
+    // Imputation statistics gathered by the last train call; its missing values were filled from these
+    const ImputationStats& getImputationStats() const { return stats; }
+};
+
+#endif // STREAMING_TRAINER_H
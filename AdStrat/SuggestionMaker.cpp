@@ -1,31 +1,56 @@
 #include <string>
 #include <vector>
+#include <algorithm>
 #include "global.h"
 #include "RandomForest.h"
+#include "SuggestionMaker.h"
 
 using namespace std;
 
+vector<PlacementScore> rankAdPlacements(const DataPoint& userPoint, const vector<string>& possiblePlacements, const RandomForest& rf) {
+    size_t count = possiblePlacements.size();
+    if (count == 0) return {};
+
+    // Encode the user once; the candidates differ only in their ad position, so the trees are
+    // walked once and only fork where they test it
+    EncodedRow user = rf.getSchema().encodeRow(userPoint);
+    EncodedBatch batch;
+    for (int c = 0; c < NUM_CATEGORICAL; ++c) {
+        batch.columns[c] = &user.codes[c];
+    }
+    batch.ages = &user.age;
+    batch.size = 1;
+
+    vector<CategoryCode> placementCodes;
+    for (const auto& placement : possiblePlacements) {
+        placementCodes.push_back(rf.getSchema().dictionary(COL_AD_POSITION).lookup(placement));
+    }
+
+    vector<int> predictions(count);
+    vector<double> probabilities(count);
+    rf.predictSweep(batch, COL_AD_POSITION, placementCodes, predictions.data(), probabilities.data());
+
+    vector<PlacementScore> ranking;
+    for (size_t i = 0; i < count; ++i) {
+        ranking.push_back({ possiblePlacements[i], probabilities[i], predictions[i] });
+    }
+    stable_sort(ranking.begin(), ranking.end(), [](const PlacementScore& a, const PlacementScore& b) {
+        return a.clickProbability > b.clickProbability;
+    });
+    return ranking;
+}
+
 // Function to suggest a better ad placement
 string suggestAdPlacement(const DataPoint& userPoint, const vector<string>& possiblePlacements, RandomForest& rf) {
-    for (const auto& placement : possiblePlacements) {
+    for (const auto& candidate : rankAdPlacements(userPoint, possiblePlacements, rf)) {
         // Skip the current ad position to avoid redundant suggestions
-        if (placement == userPoint.adPosition) {
+        if (candidate.placement == userPoint.adPosition) {
             continue;
         }
 
-        // Create a modified data point with a new ad placement
-        DataPoint modifiedPoint = userPoint;
-        modifiedPoint.adPosition = placement;
-
-        // Predict the click outcome for the modified placement
-        int prediction = rf.predict(modifiedPoint);
-
-        // If the modified placement predicts a click (1), return the suggestion
-        if (prediction == 1) {
-            return placement;
-        }
+        // The best remaining placement is only suggested if it is predicted to get a click
+        return candidate.prediction == 1 ? candidate.placement : "None";
     }
     // Return "None" if no better placement is found
     return "None";
 }
-
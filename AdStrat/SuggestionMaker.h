@@ -8,8 +8,19 @@
 
 using namespace std;
 
-// Function to suggest a better ad placement
+// A candidate placement scored by the forest
+struct PlacementScore {
+    string placement;
+    double clickProbability;  // Expected click-through rate
+    int prediction;           // Majority vote (1 = click)
+};
+
+// Scores every placement for a user in one counterfactual forest evaluation and returns them by
+// decreasing expected click-through rate (ties keep the order of possiblePlacements)
+vector<PlacementScore> rankAdPlacements(const DataPoint& userPoint, const vector<string>& possiblePlacements, const RandomForest& rf);
+
+// Function to suggest a better ad placement: the highest-ranked placement other than the
+// current one, if the forest predicts a click for it
 string suggestAdPlacement(const DataPoint& userPoint, const vector<string>& possiblePlacements, RandomForest& rf);
 
 #endif // SUGGESTIONMAKER_H
-
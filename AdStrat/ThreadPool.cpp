@@ -0,0 +1,106 @@
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Set on pool threads so nested parallelFor calls do not wait on themselves
+static thread_local bool insidePool = false;
+
+int ThreadPool::resolveThreadCount(int threads) {
+    if (threads > 0) return threads;
+    unsigned int hardware = thread::hardware_concurrency();
+    return hardware > 0 ? static_cast<int>(hardware) : 1;
+}
+
+// Creates a pool with the given number of threads (the caller counts as one of them)
+ThreadPool::ThreadPool(int threads) {
+    int count = resolveThreadCount(threads);
+    for (int i = 1; i < count; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wakeWorkers.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Claims indices of the current job until none are left
+void ThreadPool::runJob() {
+    size_t i;
+    while ((i = nextIndex.fetch_add(1)) < jobSize) {
+        try {
+            (*job)(i);
+        }
+        catch (...) {
+            lock_guard<mutex> lock(stateMutex);
+            if (!jobError) jobError = current_exception();
+            nextIndex = jobSize; // Stop handing out further work
+        }
+    }
+}
+
+void ThreadPool::workerLoop() {
+    insidePool = true;
+    size_t seenGeneration = 0;
+    while (true) {
+        {
+            unique_lock<mutex> lock(stateMutex);
+            wakeWorkers.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = generation;
+        }
+
+        runJob();
+
+        {
+            lock_guard<mutex> lock(stateMutex);
+            finishedWorkers++;
+        }
+        jobFinished.notify_one();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const function<void(size_t)>& body) {
+    if (count == 0) return;
+
+    // Run inline when there is nothing to parallelize or when called from a pool thread
+    if (workers.empty() || count == 1 || insidePool) {
+        for (size_t i = 0; i < count; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    lock_guard<mutex> jobLock(jobMutex);
+    {
+        lock_guard<mutex> lock(stateMutex);
+        job = &body;
+        jobSize = count;
+        nextIndex = 0;
+        jobError = nullptr;
+        finishedWorkers = 0;
+        generation++;
+    }
+    wakeWorkers.notify_all();
+
+    // The calling thread works on the job too
+    insidePool = true;
+    runJob();
+    insidePool = false;
+
+    exception_ptr error;
+    {
+        unique_lock<mutex> lock(stateMutex);
+        // Every worker checks in once per job, so none can still be touching it afterwards
+        jobFinished.wait(lock, [&] { return finishedWorkers == workers.size(); });
+        job = nullptr;
+        error = jobError;
+    }
+    if (error) rethrow_exception(error);
+}
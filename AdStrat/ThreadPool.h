@@ -0,0 +1,55 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Fixed-size pool of worker threads that run index-parallel loops
+class ThreadPool {
+private:
+    vector<thread> workers;
+
+    mutex jobMutex;              // Serializes parallelFor calls
+    mutex stateMutex;
+    condition_variable wakeWorkers;
+    condition_variable jobFinished;
+
+    const function<void(size_t)>* job = nullptr;
+    size_t jobSize = 0;
+    atomic<size_t> nextIndex{ 0 };
+    size_t finishedWorkers = 0;
+    size_t generation = 0;
+    bool stopping = false;
+    exception_ptr jobError;
+
+    void workerLoop();
+    void runJob();
+
+public:
+    // Creates a pool with the given number of threads (0 = hardware concurrency)
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads that execute work, including the calling thread
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+
+    // Calls body(i) for every i in [0, count) across the pool and waits for completion.
+    // The first exception thrown by body is rethrown here. Nested calls run inline.
+    void parallelFor(size_t count, const function<void(size_t)>& body);
+
+    // Resolves a requested thread count (0 or less = hardware concurrency)
+    static int resolveThreadCount(int threads);
+};
+
+#endif // THREADPOOL_H
@@ -6,9 +6,12 @@
 
 using namespace std;
 
+// Age stored for rows whose age field is empty, until it is imputed
+const int MISSING_AGE = -1;
+
 // Global struct definition
 struct DataPoint {
-    int age;
+    int age; // MISSING_AGE if not recorded
     string gender;
     string deviceType;
     string adPosition;